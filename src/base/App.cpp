@@ -6,6 +6,7 @@
 #include "3d/Mesh.hpp"
 #include "io/File.hpp"
 #include "io/StateDump.hpp"
+#include "io/MeshBinaryIO.hpp"
 #include "base/Random.hpp"
 
 #include "RayTracer.hpp"
@@ -18,6 +19,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 
 using namespace FW;
@@ -25,20 +27,12 @@ using namespace FW;
 
 //------------------------------------------------------------------------
 
-struct control {
-	bool m_RTMode;
-	bool m_JBF;
-	bool m_normalMapped;
-	bool m_useRussianRoulette;
-	int m_kernel;
-	int m_spp_server;
-	int m_numBounces;
-};
-
-struct LightControl {
-	Vec3f position;
-	Mat3f orientation;
-};
+// Finishes a wire frame into a message for the control ROUTER socket.
+static zmq::message_t toMessage(WireWriter& frame, U32 epoch)
+{
+	const Array<U8>& data = frame.finish(epoch);
+	return zmq::message_t(data.getPtr(), data.getSize());
+}
 
 bool fileExists(std::string fileName)
 {
@@ -57,13 +51,7 @@ App::App(std::vector<std::string>& cmd_args)
 	m_normalMapped(false),
 	m_img(Vec2i(10, 10), ImageFormat::RGBA_Vec4f) // will get resized immediately
 {
-	m_routerContext = zmq::context_t(1);
-	m_router = zmq::socket_t(m_routerContext, zmq::socket_type::router);
-	m_router.bind("tcp://*:5556");
-
-	m_frameContext = zmq::context_t(1);
-	m_frameRouter = zmq::socket_t(m_frameContext, zmq::socket_type::router);
-	m_frameRouter.bind("tcp://*:5557");
+	m_network.start("tcp://*:5556", "tcp://*:5557");
 
 	m_commonCtrl.showFPS(true);
 	m_commonCtrl.addStateObject(this);
@@ -74,6 +62,21 @@ App::App(std::vector<std::string>& cmd_args)
 	m_kernel = 6;
 	m_spp = 4;
 	m_spp_server = 4;
+	m_exposure = 1.0f;
+	m_tonemap = Tonemap_None;
+	m_frameEncoding = FrameEncoding_RGB9E5;
+	m_frameDeflate = false;
+	m_frameDelta = true;
+	m_pullTiles = false;
+	m_localBackfill = true;
+	m_framesInFlight = 3;
+	m_foveated = false;
+	m_focus = Vec2f(0.5f);
+	m_foveaRadius = 0.15f;
+	m_foveaFalloff = 0.15f;
+	m_foveaMinScale = 0.25f;
+	m_previewScale = 2;
+	m_pinThreads = false;
 	m_commonCtrl.addToggle(&m_JBF, FW_KEY_NONE, "Enable Joint Bilateral Filtering(slow)");
 	m_commonCtrl.addToggle(&m_JBF_server, FW_KEY_NONE, "Enable Joint Bilateral Filtering(slow) on server");
 	m_commonCtrl.beginSliderStack();
@@ -81,7 +84,28 @@ App::App(std::vector<std::string>& cmd_args)
 	m_commonCtrl.addSlider(&m_spp, 1, 512, false, FW_KEY_NONE, FW_KEY_NONE, "Sample Per Pixel= %d", 0, &clear_on_next_frame);
 	m_commonCtrl.addSlider(&m_spp_server, 1, 512, false, FW_KEY_NONE, FW_KEY_NONE, "Sample Per Pixel of Server= %d", 0, &clear_on_next_frame);
 	m_commonCtrl.addSlider(&m_numBounces, 0, 8, false, FW_KEY_NONE, FW_KEY_NONE, "Number of indirect bounces= %d", 0, &clear_on_next_frame);
+	m_commonCtrl.addSlider(&m_framesInFlight, 0, 16, false, FW_KEY_NONE, FW_KEY_NONE, "Server frames in flight= %d (0 = no flow control)");
+	m_commonCtrl.addSlider(&m_exposure, 0.05f, 20.0f, true, FW_KEY_NONE, FW_KEY_NONE, "Exposure= %.2f", 0.25f);
+	m_commonCtrl.addSlider(&m_foveaRadius, 0.02f, 1.0f, true, FW_KEY_NONE, FW_KEY_NONE, "Fovea radius= %.2f image heights", 0.25f, &clear_on_next_frame);
+	m_commonCtrl.addSlider(&m_foveaFalloff, 0.02f, 1.0f, true, FW_KEY_NONE, FW_KEY_NONE, "Fovea falloff= %.2f image heights", 0.25f, &clear_on_next_frame);
+	m_commonCtrl.addSlider(&m_foveaMinScale, 0.05f, 1.0f, false, FW_KEY_NONE, FW_KEY_NONE, "Peripheral sample rate= %.2f", 0.25f, &clear_on_next_frame);
 	m_commonCtrl.endSliderStack();
+	m_commonCtrl.addToggle(&m_tonemap, Tonemap_None, FW_KEY_NONE, "No tonemapping");
+	m_commonCtrl.addToggle(&m_tonemap, Tonemap_Reinhard, FW_KEY_NONE, "Reinhard tonemapping");
+	m_commonCtrl.addToggle(&m_tonemap, Tonemap_ACES, FW_KEY_NONE, "ACES filmic tonemapping");
+	m_commonCtrl.addToggle(&m_frameEncoding, FrameEncoding_RGB32F, FW_KEY_NONE, "Server frames as RGB32F (12 B/pixel)");
+	m_commonCtrl.addToggle(&m_frameEncoding, FrameEncoding_RGB16F, FW_KEY_NONE, "Server frames as RGB16F (6 B/pixel)");
+	m_commonCtrl.addToggle(&m_frameEncoding, FrameEncoding_RGB9E5, FW_KEY_NONE, "Server frames as RGB9E5 (4 B/pixel)");
+	m_commonCtrl.addToggle(&m_frameEncoding, FrameEncoding_RGBE, FW_KEY_NONE, "Server frames as RGBE (4 B/pixel)");
+	m_commonCtrl.addToggle(&m_frameDeflate, FW_KEY_NONE, "Deflate server frames");
+	m_commonCtrl.addToggle(&m_frameDelta, FW_KEY_NONE, "Server frames as changed-tile deltas");
+	m_commonCtrl.addToggle(&m_pullTiles, FW_KEY_NONE, "Servers pull tiles instead of fixed strips");
+	m_commonCtrl.addToggle(&m_localBackfill, FW_KEY_NONE, "Render indirect light locally where servers are late");
+	m_commonCtrl.addToggle(&m_previewScale, 1, FW_KEY_NONE, "Full resolution while the camera moves");
+	m_commonCtrl.addToggle(&m_previewScale, 2, FW_KEY_NONE, "Half resolution preview while the camera moves");
+	m_commonCtrl.addToggle(&m_previewScale, 4, FW_KEY_NONE, "Quarter resolution preview while the camera moves");
+	m_commonCtrl.addToggle(&m_foveated, FW_KEY_NONE, "Foveated rendering (middle click sets the focus)", &clear_on_next_frame);
+	m_commonCtrl.addToggle(&m_pinThreads, FW_KEY_NONE, "Pin render threads to cores, NUMA node per row band", &clear_on_next_frame);
 
 	//m_commonCtrl.addButton((S32*)&m_action, Action_LoadMesh, FW_KEY_M, "Load mesh or state... (M)");
 	//m_commonCtrl.addButton((S32*)&m_action, Action_ReloadMesh, FW_KEY_F5, "Reload mesh (F5)");
@@ -147,10 +171,18 @@ App::App(std::vector<std::string>& cmd_args)
 
 	process_args(cmd_args);
 
+	LoopbackConfig loopback;
+	int numLoopback = LoopbackServer::parseArgs(cmd_args, loopback);
+	for (int i = 0; i < numLoopback; ++i) {
+		m_loopbackServers.emplace_back(new LoopbackServer(sprintf("loopback-%d", i).getPtr(), loopback));
+		m_loopbackServers.back()->start();
+	}
+	m_bench.start = std::chrono::steady_clock::now();
+
 	m_commonCtrl.loadState(m_commonCtrl.getStateFileName(1));
 
 	m_timer.start();
-	m_lastTimestamp = std::chrono::steady_clock::now();
+	m_lastRebalance = std::chrono::steady_clock::now();
 }
 
 // returns the index of the needle in the haystack or -1 if not found
@@ -166,8 +198,10 @@ int find_argument(std::string needle, std::vector<std::string> haystack) {
 void App::process_args(std::vector<std::string>& args) {
 
 	// all of the possible cmd arguments and the corresponding enums (enum value is the index of the string in the vector)
-	const std::vector<std::string> argument_names = { "-builder", "-spp", "-output_images", "-use_textures", "-bat_render", "-aa", "-ao", "-ao_length" };
-	enum argument { arg_not_found = -1, builder = 0, spp = 1, output_images = 2, use_textures = 3, bat_render = 4, AA = 5, AO = 6, AO_length = 7 };
+	const std::vector<std::string> argument_names = { "-builder", "-spp", "-output_images", "-use_textures", "-bat_render", "-aa", "-ao", "-ao_length", "-benchmark",
+		"-loopback", "-loopback_throughput", "-loopback_latency", "-loopback_jitter", "-loopback_fail", "-loopback_host" };
+	enum argument { arg_not_found = -1, builder = 0, spp = 1, output_images = 2, use_textures = 3, bat_render = 4, AA = 5, AO = 6, AO_length = 7, benchmark = 8,
+		loopback_first = 9, loopback_last = 14 };
 
 	// similarly a list of the implemented BVH builder types
 	const std::vector<std::string> builder_names = { "none", "sah", "object_median", "spatial_median", "linear" };
@@ -192,6 +226,10 @@ void App::process_args(std::vector<std::string>& args) {
 			m_settings.batch_render = true;
 			break;
 
+		case benchmark:
+			m_benchmark = true;
+			break;
+
 		case output_images:
 			m_settings.output_images = true;
 			break;
@@ -257,6 +295,11 @@ void App::process_args(std::vector<std::string>& args) {
 
 
 		default:
+			// stand-in servers, see LoopbackServer::parseArgs
+			if (cmd >= loopback_first && cmd <= loopback_last) {
+				++i;
+				break;
+			}
 			if (args[i][0] == '-')std::cout << "argument \"" << args[i] << "\" not found!" << std::endl;
 
 		}
@@ -269,6 +312,8 @@ void App::process_args(std::vector<std::string>& args) {
 
 App::~App()
 {
+	m_loopbackServers.clear();
+	m_network.stop();
 }
 
 //------------------------------------------------------------------------
@@ -278,8 +323,9 @@ bool App::handleEvent(const Window::Event& ev)
 	if (ev.type == Window::EventType_Close)
 	{
 		m_window.showModalMessage("Exiting...");
-		bool temp[2] = { true, true };
-		m_cameraCtrl.sendControl(&temp, 2 * sizeof(bool));
+		WireWriter shutdown;
+		writeWire(shutdown, WireMessage_Shutdown);
+		m_cameraCtrl.sendControl(shutdown);
 		delete this;
 		return true;
 	}
@@ -450,10 +496,11 @@ bool App::handleEvent(const Window::Event& ev)
 	case Action_PlaceLightSourceAtCamera: {
 		m_areaLight->setOrientation(m_cameraCtrl.getCameraToWorld().getXYZ());
 		m_areaLight->setPosition(m_cameraCtrl.getPosition());
-		initState.m_lightOrientation = m_areaLight->getOrientation();
-		initState.m_lightPosition = m_areaLight->getPosition();
-		LightControl temp = { m_areaLight->getPosition(),m_areaLight->getOrientation() };
-		m_cameraCtrl.sendControl(&temp, sizeof(LightControl));
+		initState.m_light.orientation = m_areaLight->getOrientation();
+		initState.m_light.position = m_areaLight->getPosition();
+		WireWriter light;
+		writeWire(light, initState.m_light);
+		m_cameraCtrl.sendControl(light);
 		m_commonCtrl.message("Placed light at camera");
 		break;
 	}
@@ -462,34 +509,44 @@ bool App::handleEvent(const Window::Event& ev)
 		m_RTMode = !m_RTMode;
 		if (m_RTMode)
 		{
-			control ctl = { m_RTMode, m_JBF_server, m_normalMapped, m_useRussianRoulette, m_kernel, m_spp_server, m_numBounces };
-			m_cameraCtrl.sendControl(&ctl, sizeof(control));
-			initState.m_RTMode = m_RTMode;
-			initState.m_JBF_server = m_JBF_server;
-			initState.m_normalMapped = m_normalMapped;
-			initState.m_useRussianRoulette = m_useRussianRoulette;
-			initState.m_kernel = m_kernel;
-			initState.m_spp_server = m_spp_server;
-			initState.m_numBounces = m_numBounces;
+			// settings and size go out in one frame
+			initState.m_settings = getRenderSettings();
+			WireWriter control;
+			writeWire(control, initState.m_settings);
+			bool resized = m_img.getSize() != m_window.getSize();
+			if (resized) {
+				WireResize resize = { Vec2f(m_window.getSize()) };
+				writeWire(control, resize);
+			}
+			m_cameraCtrl.sendControl(control);
+
 			m_pathtrace_renderer->stop();
-			if (m_img.getSize() != m_window.getSize())
+			if (resized)
 			{
 				// Replace m_img with a new Image. TODO: Clean this up.
-				Vec2f tmp = m_window.getSize();
-				m_cameraCtrl.sendControl(&tmp, sizeof(Vec2f));
 				m_img.~Image();
 				new (&m_img) Image(m_window.getSize(), ImageFormat::RGBA_Vec4f);	// placement new, will get autodestructed
+				sendAssignments();
 			}
+			else if (m_stripsPending && !initState.m_settings.pullTiles)
+				sendAssignments();
 			m_pathtrace_renderer->setNormalMapped(m_normalMapped);
 			m_pathtrace_renderer->setJBF(m_JBF);
 			m_pathtrace_renderer->setKernel(m_kernel);
 			m_pathtrace_renderer->setSPP(m_spp);
+			updateFoveation();
+			m_pathtrace_renderer->setFoveation(initState.m_foveation);
+			m_pathtrace_renderer->setPreviewScale(initState.m_preview.scale);
+			m_pathtrace_renderer->setExposure(m_exposure);
+			m_pathtrace_renderer->setTonemap((Tonemap)m_tonemap);
 			m_pathtrace_renderer->startPathTracingProcess(m_mesh.get(), m_areaLight.get(), m_rt.get(), &m_img, m_useRussianRoulette ? -m_numBounces : m_numBounces, m_cameraCtrl);
 		}
 		else
 		{
-			initState.m_RTMode = m_RTMode;
-			m_cameraCtrl.sendControl(&m_RTMode, sizeof(bool));
+			initState.m_settings.rtMode = m_RTMode;
+			WireWriter control;
+			writeWire(control, initState.m_settings);
+			m_cameraCtrl.sendControl(control);
 			m_pathtrace_renderer->stop();
 		}
 		break;
@@ -498,6 +555,12 @@ bool App::handleEvent(const Window::Event& ev)
 		break;
 		}
 
+	if (ev.type == Window::EventType_KeyDown && ev.key == FW_KEY_MOUSE_MIDDLE && m_foveated)
+	{
+		m_focus = Vec2f(ev.mousePos) / Vec2f(max(m_window.getSize(), Vec2i(1)));
+		clear_on_next_frame = true;
+	}
+
 	if (ev.type == Window::EventType_KeyUp)
 	{
 		if (ev.key == FW_KEY_CONTROL)
@@ -520,75 +583,62 @@ bool App::handleEvent(const Window::Event& ev)
 
 
 	auto currentTimestamp = std::chrono::steady_clock::now();
-	if (std::chrono::duration_cast<std::chrono::seconds>(currentTimestamp - m_lastTimestamp).count() >= 6) {
-		if (m_servers.size() != m_aliveServers.size()) {
-			std::cout << "some servers is dead" << std::endl;
-
-			m_servers = std::move(m_aliveServers);
-
-			int blockId = 0;
-			int blockNum = m_servers.size();
-			for (auto& it : m_servers) {
-				zmq::message_t message(sizeof(int) * 2);
-				std::memcpy(static_cast<int*>(message.data()), &blockId, sizeof(int));
-				std::memcpy(static_cast<int*>(message.data()) + 1, &blockNum, sizeof(int));
-
-				m_router.send(zmq::buffer(it.first), zmq::send_flags::sndmore);
-				m_router.send(message, zmq::send_flags::none);
-
-				it.second = blockId;
-				blockId++;
-			}
-		}
-		else {
-			for (auto& it : m_servers) {
-				// send heart heat
-				m_router.send(zmq::buffer(it.first), zmq::send_flags::sndmore);
-				m_router.send(zmq::buffer("1"), zmq::send_flags::none);
-			}
-		}
-
-		m_lastTimestamp = std::chrono::steady_clock::now();
-		m_aliveServers.clear();
-	}
+	m_heartbeats.service(currentTimestamp);
 
 	// send client state to initialize server or
 	// re-schedule load when some servers disconnect
-	zmq::message_t identity;
-	bool received = m_router.recv(identity, zmq::recv_flags::dontwait).has_value();
-	if (received) {
-		std::string clientID(static_cast<char*>(identity.data()), identity.size());
-
-		zmq::message_t request;
-		m_router.recv(request, zmq::recv_flags::none);
-		std::string requestData(static_cast<char*>(request.data()), request.size());
+	RouterMessage received;
+	while (m_network.receiveControl(received)) {
+		const std::string& clientID = received.server;
+		const zmq::message_t& request = received.payload;
+		std::string requestData(static_cast<const char*>(request.data()), request.size());
 		// std::cout << "Received from " << clientID << ": " << requestData << std::endl;
 
+		// anything that is not a wire frame counts as a plain heartbeat
+		WireReader reader;
+		WireWriter chunks;
+		bool isTileRequest = false;
+		if (reader.reset(request.data(), (int)request.size()))
+			while (reader.nextMessage()) {
+				isTileRequest |= reader.getType() == WireMessage_TileRequest;
+				WireHeartbeat echo;
+				if (readWire(reader, echo))
+					m_heartbeats.recordEcho(clientID, echo.sequence, currentTimestamp);
+				WireAssetRequest assetRequest;
+				if (readWire(reader, assetRequest))
+					m_assets.serveRequest(assetRequest, chunks);
+			}
+		if (chunks.getNumMessages())
+			m_network.send(clientID, toMessage(chunks, m_cameraCtrl.getEpoch()));
+
 		if (m_servers.find(clientID) != m_servers.end()) {
-			m_aliveServers.emplace(clientID, m_servers[clientID]);
-			// std::cout << "receive heart beat from" << clientID << std::endl;
+			// any message doubles as a heartbeat
+			if (isTileRequest)
+				serveTileRequest(clientID, reader.getEpoch());
+			m_heartbeats.recordTraffic(clientID, currentTimestamp);
 		}
 		else {
 			int blockNum = m_servers.size() + 1;
 
-			// send current client state
-			initState.m_position = m_cameraCtrl.getPosition();
-			initState.m_forward = m_cameraCtrl.getForward();
-			initState.m_up = m_cameraCtrl.getUp();
-			initState.m_size = m_window.getSize();
-			initState.m_fov = m_cameraCtrl.getFOV();
-			initState.m_blockId = m_servers.size();
-			initState.m_blockNum = blockNum;
-			zmq::message_t message(sizeof(InitialState) + m_scene.getLength() + 1);
-			std::memcpy(message.data(), &initState, sizeof(InitialState));
-			std::memcpy(static_cast<char*>(message.data()) + sizeof(InitialState), m_scene.getPtr(), m_scene.getLength() + 1);
-			m_router.send(identity, zmq::send_flags::sndmore);
-			m_router.send(message, zmq::send_flags::none);
-
-			m_cameraCtrl.sendControl(&blockNum, sizeof(int));
+			// send current client state, all in one frame; any later camera
+			// snapshot has a higher sequence number than 0
+			WireWriter state;
+			WireCameraState camera = { 0, m_cameraCtrl.getPosition(), m_cameraCtrl.getForward(), m_cameraCtrl.getUp(), m_cameraCtrl.getFOV() };
+			WireResize size = { Vec2f(m_window.getSize()) };
+			WireStripAssignment strip = { (S32)m_servers.size(), blockNum, 0, 0 };
+			writeWire(state, camera);
+			writeWire(state, initState.m_light);
+			writeWire(state, size);
+			writeWire(state, initState.m_settings);
+			writeWire(state, initState.m_foveation);
+			writeWire(state, initState.m_preview);
+			writeWire(state, strip);
+			writeScene(state);
+			m_network.send(clientID, toMessage(state, m_cameraCtrl.getEpoch()));
 
 			m_servers.emplace(clientID, m_servers.size());
-			m_aliveServers.emplace(clientID, m_servers[clientID]);
+			m_heartbeats.addServer(clientID, currentTimestamp);
+			sendAssignments();
 		}
 
 		//// send current client state
@@ -603,6 +653,35 @@ bool App::handleEvent(const Window::Event& ev)
 		//m_router.send(message, zmq::send_flags::none);
 	}
 
+	// servers that stopped answering lose their rows to the others right away; their
+	// queued messages are read first, so a stall of this loop alone does not count
+	std::vector<std::string> deadServers;
+	m_heartbeats.collectDead(currentTimestamp, deadServers);
+	if (!deadServers.empty())
+		removeServers(deadServers);
+
+	std::vector<std::pair<std::string, U32> > pings;
+	m_heartbeats.collectPings(currentTimestamp, pings);
+	for (auto& it : pings) {
+		WireWriter heartbeat;
+		WireHeartbeat ping = { it.second };
+		writeWire(heartbeat, ping);
+		m_network.send(it.first, toMessage(heartbeat, m_cameraCtrl.getEpoch()));
+	}
+
+	// move rows from slow to fast servers once enough frames have been measured
+	if (currentTimestamp - m_lastRebalance >= std::chrono::seconds(2)) {
+		rebalance();
+		m_lastRebalance = currentTimestamp;
+	}
+
+	if (m_benchmark && currentTimestamp - m_bench.start >= std::chrono::seconds(1))
+		reportBenchmark();
+
+	// tiles whose server went quiet are handed to the next one that asks
+	if (m_pullTiles)
+		m_tileScheduler.checkTimeouts(1.5f);
+
 	m_window.setVisible(true);
 
 	if (ev.type == Window::EventType_Paint)
@@ -628,11 +707,15 @@ void App::readState(StateDump& d)
 	m_lightSize = m_areaLight->getSize().x;	// dirty; doesn't allow for rectangular lights, only square. TODO
 
 	if (m_meshFileName != meshFileName && meshFileName.getLength()) {
-		m_cameraCtrl.sendControl(m_commonCtrl.m_currentScene.getPtr(), m_commonCtrl.m_currentScene.getLength() + 1);
 		m_scene = m_commonCtrl.m_currentScene;
-		initState.m_lightPosition = m_areaLight->getPosition();
-		initState.m_lightOrientation = m_areaLight->getOrientation();
+		initState.m_light.position = m_areaLight->getPosition();
+		initState.m_light.orientation = m_areaLight->getOrientation();
 		loadMesh(meshFileName);
+
+		// sent once the mesh is loaded, so the manifest lists the new assets
+		WireWriter scene;
+		writeScene(scene);
+		m_cameraCtrl.sendControl(scene);
 	}
 	}
 
@@ -663,29 +746,63 @@ void App::waitKey(void)
 
 void App::renderFrame(GLContext* gl)
 {
+	// Frames of the current epoch must survive while the local pass runs; the delta
+	// encoders on the servers count them as sent either way.
+	m_network.setEpoch(m_cameraCtrl.getEpoch());
+
 	// Setup transformations.
 
 	Mat4f worldToCamera = m_cameraCtrl.getWorldToCamera();
 	Mat4f projection = gl->xformFitToView(Vec2f(-1.0f, -1.0f), Vec2f(2.0f, 2.0f)) * m_cameraCtrl.getCameraToClip();
 	Mat4f worldToClip = projection * worldToCamera;
 
+	// full resolution resumes once the camera has been still for a moment
+	if (updatePreview(worldToClip != previous_camera))
+		clear_on_next_frame = true;
+
+	// exposure and tonemapping only change the resolve, so the buffers are shown again as they are
+	const ResolveParams& resolve = m_pathtrace_renderer->getResolveParams();
+	if (m_exposure != resolve.exposure || m_tonemap != resolve.tonemap)
+	{
+		m_pathtrace_renderer->setExposure(m_exposure);
+		m_pathtrace_renderer->setTonemap((Tonemap)m_tonemap);
+		if (m_RTMode)
+			m_pathtrace_renderer->resolve(&m_img);
+	}
+
+	// threads move to other cores => buffers are reallocated so the new owners touch them first
+	if (m_pinThreads != MulticoreLauncher::getPinThreads())
+	{
+		m_pathtrace_renderer->releaseBuffers();
+		MulticoreLauncher::setPinThreads(m_pinThreads);
+	}
+
 	if (worldToClip != previous_camera || clear_on_next_frame)
 	{
 		previous_camera = worldToClip;
 		clear_on_next_frame = false;
 
-		m_pathtrace_renderer->stop();
-
 		if (m_img.getSize() != m_window.getSize())
 		{
 			// Replace m_img with a new Image. TODO: Clean this up.
-			Vec2f tmp = m_window.getSize();
-			m_cameraCtrl.sendControl(&tmp, sizeof(Vec2f));
+			m_pathtrace_renderer->stop();
+			WireWriter control;
+			WireResize resize = { Vec2f(m_window.getSize()) };
+			writeWire(control, resize);
+			m_cameraCtrl.sendControl(control);
 			m_img.~Image();
 			new (&m_img) Image(m_window.getSize(), ImageFormat::RGBA_Vec4f);	// placement new, will get autodestructed
+			sendAssignments();
 		}
 
-		m_pathtrace_renderer->startPathTracingProcess(m_mesh.get(), m_areaLight.get(), m_rt.get(), &m_img, m_useRussianRoulette ? -m_numBounces : m_numBounces, m_cameraCtrl);
+		updateFoveation();
+		m_pathtrace_renderer->setFoveation(initState.m_foveation);
+		m_pathtrace_renderer->setPreviewScale(initState.m_preview.scale);
+		m_pathtrace_renderer->setExposure(m_exposure);
+		m_pathtrace_renderer->setTonemap((Tonemap)m_tonemap);
+
+		// the old pass is cancelled without waiting for it; the new one starts from checkFinish
+		m_pathtrace_renderer->restartPathTracingProcess(m_mesh.get(), m_areaLight.get(), m_rt.get(), &m_img, m_useRussianRoulette ? -m_numBounces : m_numBounces, m_cameraCtrl);
 	}
 
 	glClearColor(0.2f, 0.4f, 0.8f, 1.0f);
@@ -694,7 +811,7 @@ void App::renderFrame(GLContext* gl)
 	if (m_RTMode)
 	{
 		// if we are computing radiosity, refresh mesh colors every 0.5 seconds
-		if (m_pathtrace_renderer->isRunning())
+		if (m_pathtrace_renderer->isRunning() && !m_pathtrace_renderer->isBackfilling())
 		{
 			m_pathtrace_renderer->updatePicture(&m_img);
 			m_pathtrace_renderer->checkFinish();
@@ -710,28 +827,61 @@ void App::renderFrame(GLContext* gl)
 		else 
 		{
 			
-			zmq::message_t identity;
-			bool received = m_frameRouter.recv(identity, zmq::recv_flags::dontwait).has_value();
-			if (received) {
-				std::string clientID(static_cast<char*>(identity.data()), identity.size());
-
-				zmq::message_t frame;
-				m_frameRouter.recv(frame, zmq::recv_flags::none);
-
-				// std::cout << "Received frame" << std::endl;
-
-				int blockId = m_servers[clientID];
-				int blockNum = m_servers.size();
+			// Drain all queued frames so stale ones cannot pile up, then blend
+			// each touched strip once.
+			int blockNum = m_strips.size();
+			std::vector<bool> dirty(blockNum, false);
+			int image_height = m_img.getSize().y;
+
+			if (m_balancedEpoch != m_cameraCtrl.getEpoch()) {
+				m_balancedEpoch = m_cameraCtrl.getEpoch();
+				m_loadBalancer.startEpoch();
+			}
+			syncTileScheduler();
+
+			// rows touched by pulled tiles or a finished backfill pass
+			int tileRowStart = image_height;
+			int tileRowEnd = 0;
+			int backfillStart, backfillEnd;
+			if (m_pathtrace_renderer->finishBackfill(backfillStart, backfillEnd)) {
+				tileRowStart = backfillStart;
+				tileRowEnd = backfillEnd;
+			}
 
-				int image_height = m_img.getSize().y;
-				int vBlockHeight = image_height / blockNum;
-				int vBlockStart = blockId * vBlockHeight;
-				int vHeight = blockId == blockNum - 1 ? image_height - vBlockStart : vBlockHeight;
+			// frames were received and decoded on the network thread
+			m_network.setEpoch(m_cameraCtrl.getEpoch());
+			while (std::unique_ptr<ReceivedFrame> frame = m_network.receiveFrame()) {
+				if (m_benchmark)
+					measureFrame(*frame);
+				mergeFrame(*frame, dirty, tileRowStart, tileRowEnd);
+				// rejected frames used up a credit as well
+				if (frame->header.magic && frame->header.epoch == m_cameraCtrl.getEpoch())
+					m_frameCredits[frame->server]++;
+				m_network.recycleFrame(std::move(frame));
+			}
+			if (!m_frameCredits.empty())
+				returnCredits();
 
-				m_pathtrace_renderer->pixelColor.resize(vHeight * m_img.getSize().x);
-				memcpy(m_pathtrace_renderer->pixelColor.data(), frame.data(), frame.size());
-				m_pathtrace_renderer->blendFrame(&m_img, vBlockStart, vHeight);
+			Timer blendTimer(true);
+			int numBlends = 0;
+			for (int blockId = 0; blockId < blockNum; ++blockId)
+			{
+				if (dirty[blockId]) {
+					m_pathtrace_renderer->blendFrame(&m_img, m_strips[blockId].vStart, m_strips[blockId].vHeight);
+					numBlends++;
+				}
+			}
+			if (tileRowStart < tileRowEnd) {
+				m_pathtrace_renderer->blendFrame(&m_img, tileRowStart, tileRowEnd - tileRowStart);
+				numBlends++;
+			}
+			if (m_benchmark && numBlends) {
+				m_bench.blendSeconds += blendTimer.getElapsed();
+				m_bench.blends += numBlends;
 			}
+
+			if (m_localBackfill && !m_pathtrace_renderer->isBackfilling())
+				scheduleBackfill();
 		}
 
 		gl->drawImage(m_img, Vec2f(0));
@@ -974,6 +1124,11 @@ void App::constructTracer()
 		}
 	}
 
+	// convert material textures and normal mapping frames to their render-side form once per mesh
+	m_textureCache.build(*m_mesh, m_rtTriangles);
+	PathTraceRenderer::setTextureCache(&m_textureCache);
+	m_shadingFrames.build(m_rtTriangles);
+	PathTraceRenderer::setShadingFrames(&m_shadingFrames);
 
 	// compute checksum
 
@@ -1049,6 +1204,387 @@ void App::constructTracer()
 		std::cout << "Build time: " << m_results.build_time << " ms"<< std::endl;
 	}
 
+	publishAssets(md5);
+}
+
+//------------------------------------------------------------------------
+
+void App::sendAssignments()
+{
+	// servers in block id order
+	std::vector<std::string> servers(m_servers.size());
+	for (auto& it : m_servers)
+		servers[it.second] = it.first;
+
+	m_loadBalancer.computeLayout(m_strips, servers, m_window.getSize().x, m_window.getSize().y, m_spp_server);
+
+	// servers pulling tiles ignore strips, and a new epoch would only throw away the tiles
+	// in flight; the layout goes out once strips are back in use
+	m_stripsPending = initState.m_settings.pullTiles;
+	if (m_stripsPending)
+		return;
+
+	// the new layout starts a new epoch, so strips rendered for the old one get dropped
+	int blockNum = servers.size();
+	U32 epoch = m_cameraCtrl.advanceEpoch();
+	m_balancedEpoch = epoch;
+	m_loadBalancer.startEpoch();
+
+	for (int blockId = 0; blockId < blockNum; ++blockId) {
+		WireWriter frame;
+		WireStripAssignment assignment = { blockId, blockNum, m_strips[blockId].vStart, m_strips[blockId].vHeight };
+		writeWire(frame, assignment);
+		m_network.send(servers[blockId], toMessage(frame, epoch));
+	}
+	m_network.setEpoch(epoch);
+}
+
+//------------------------------------------------------------------------
+
+void App::removeServers(const std::vector<std::string>& dead)
+{
+	for (const std::string& server : dead) {
+		m_servers.erase(server);
+		m_loadBalancer.removeServer(server);
+		m_tileScheduler.releaseServer(server);
+	}
+
+	FW::printf("%d server(s) timed out, %d left\n", (int)dead.size(), (int)m_servers.size());
+
+	int blockId = 0;
+	for (auto& it : m_servers)
+		it.second = blockId++;
+	sendAssignments();
+}
+
+//------------------------------------------------------------------------
+
+void App::rebalance()
+{
+	// tiles are measured one by one, not strips
+	if (m_servers.size() < 2 || initState.m_settings.pullTiles)
+		return;
+
+	std::vector<std::string> servers(m_servers.size());
+	for (auto& it : m_servers)
+		servers[it.second] = it.first;
+
+	// every reassignment discards frames in flight, so only act on clear imbalance
+	std::vector<LoadBalancer::Strip> layout;
+	m_loadBalancer.computeLayout(layout, servers, m_window.getSize().x, m_window.getSize().y, m_spp_server);
+	if (LoadBalancer::differs(layout, m_strips, m_window.getSize().y, 0.05f))
+		sendAssignments();
+}
+
+//------------------------------------------------------------------------
+
+// Starts a local pass of indirect light over the strips whose server has not sent anything
+// for this epoch well after it usually would, or over the whole image without servers.
+// Passes repeat while the strips stay overdue; frames arriving later are blended with the
+// local samples by weight rather than replacing them.
+void App::scheduleBackfill()
+{
+	F64 sinceEpoch = std::chrono::duration<F64>(std::chrono::steady_clock::now() - m_loadBalancer.getEpochStart()).count();
+	int image_height = m_img.getSize().y;
+
+	std::vector<Vec2i> rows;
+	if (m_servers.empty())
+		rows.push_back(Vec2i(0, image_height));
+	else if (!m_pullTiles) {
+		for (auto& it : m_servers) {
+			if (it.second >= (int)m_strips.size())
+				continue;
+
+			// twice the usual latency, or half a second for servers not measured yet
+			const LoadBalancer::ServerStats* stats = m_loadBalancer.getStats(it.first);
+			if (stats && stats->seenThisEpoch)
+				continue;
+			F64 deadline = (stats && stats->latency > 0.0) ? max(stats->latency * 2.0, 0.1) : 0.5;
+			if (sinceEpoch < deadline)
+				continue;
+
+			const LoadBalancer::Strip& strip = m_strips[it.second];
+			rows.push_back(Vec2i(strip.vStart, min(strip.vStart + strip.vHeight, image_height)));
+		}
+	}
+
+	if (!rows.empty())
+		m_pathtrace_renderer->startBackfill(rows);
+}
+
+//------------------------------------------------------------------------
+
+// Servers render ahead while earlier frames are in transit, but only as many frames as
+// they have credits for; each merged frame earns its server one back.
+void App::returnCredits()
+{
+	if (initState.m_settings.framesInFlight) {
+		for (auto& it : m_frameCredits) {
+			WireWriter frame;
+			WireFrameCredit credit = { it.second };
+			writeWire(frame, credit);
+			m_network.send(it.first, toMessage(frame, m_cameraCtrl.getEpoch()));
+		}
+	}
+	m_frameCredits.clear();
+}
+
+//------------------------------------------------------------------------
+
+// Latency is measured like the load balancer does: from the start of an epoch to the
+// first frame each server sends for it.
+void App::measureFrame(const ReceivedFrame& frame)
+{
+	m_bench.frames++;
+	m_bench.bytes += frame.message.size();
+
+	const LoadBalancer::ServerStats* stats = m_loadBalancer.getStats(frame.server);
+	bool current = frame.header.magic == 0 || frame.header.epoch == m_cameraCtrl.getEpoch();
+	if (current && (!stats || !stats->seenThisEpoch) && m_servers.count(frame.server)) {
+		F64 latency = std::chrono::duration<F64>(std::chrono::steady_clock::now() - m_loadBalancer.getEpochStart()).count();
+		m_bench.latencySum += latency;
+		m_bench.latencyMax = max(m_bench.latencyMax, latency);
+		m_bench.latencies++;
+	}
+}
+
+void App::reportBenchmark()
+{
+	auto now = std::chrono::steady_clock::now();
+	F64 seconds = std::chrono::duration<F64>(now - m_bench.start).count();
+	U32 stale = m_network.getNumStaleFrames() - m_bench.staleBase;
+	U32 dropped = m_network.getNumDroppedFrames() - m_bench.droppedBase;
+	U32 arrived = m_bench.frames + stale + dropped;
+
+	FW::printf("net: %d servers, %.1f frames/s, %.2f MB/s, latency %.1f ms (max %.1f), blend %.2f ms, stale %.1f%%, dropped %u\n",
+		(int)m_servers.size(),
+		m_bench.frames / seconds,
+		m_bench.bytes / seconds / 1048576.0,
+		m_bench.latencies ? m_bench.latencySum / m_bench.latencies * 1000.0 : 0.0,
+		m_bench.latencyMax * 1000.0,
+		m_bench.blends ? m_bench.blendSeconds / m_bench.blends * 1000.0 : 0.0,
+		arrived ? 100.0 * stale / arrived : 0.0,
+		dropped);
+
+	m_bench = NetBenchmark();
+	m_bench.start = now;
+	m_bench.staleBase = m_network.getNumStaleFrames();
+	m_bench.droppedBase = m_network.getNumDroppedFrames();
+}
+
+//------------------------------------------------------------------------
+
+WireRenderSettings App::getRenderSettings() const
+{
+	WireRenderSettings settings;
+	settings.rtMode = m_RTMode;
+	settings.jbf = m_JBF_server;
+	settings.normalMapped = m_normalMapped;
+	settings.russianRoulette = m_useRussianRoulette;
+	settings.kernel = m_kernel;
+	settings.spp = m_spp_server;
+	settings.numBounces = m_numBounces;
+	settings.frameEncoding = (U8)m_frameEncoding;
+	settings.frameFlags = (U8)getFrameFlags();
+	settings.pullTiles = m_pullTiles;
+	settings.framesInFlight = (U8)m_framesInFlight;
+	return settings;
+}
+
+WireFoveation App::getFoveation() const
+{
+	WireFoveation foveation;
+	foveation.enabled = m_foveated;
+	foveation.focus = m_focus;
+	foveation.radius = m_foveaRadius;
+	foveation.falloff = m_foveaFalloff;
+	foveation.minScale = m_foveaMinScale;
+	return foveation;
+}
+
+// Servers and the local pass drop to m_previewScale while the camera moves, and back to full
+// resolution once it has been still for a quarter of a second. Returns true on a change.
+bool App::updatePreview(bool cameraMoved)
+{
+	auto now = std::chrono::steady_clock::now();
+	if (cameraMoved)
+		m_lastCameraMove = now;
+	bool moving = m_RTMode && now - m_lastCameraMove < std::chrono::milliseconds(250);
+	U8 scale = (U8)(moving ? m_previewScale : 1);
+	if (scale == initState.m_preview.scale)
+		return false;
+
+	initState.m_preview.scale = scale;
+	WireWriter control;
+	writeWire(control, initState.m_preview);
+	m_cameraCtrl.sendControl(control);
+	return true;
+}
+
+// Servers restart when the region of interest changes, like for any other control message.
+void App::updateFoveation()
+{
+	WireFoveation foveation = getFoveation();
+	const WireFoveation& sent = initState.m_foveation;
+	if (foveation.enabled == sent.enabled && foveation.focus == sent.focus && foveation.radius == sent.radius
+		&& foveation.falloff == sent.falloff && foveation.minScale == sent.minScale)
+		return;
+
+	initState.m_foveation = foveation;
+	WireWriter control;
+	writeWire(control, foveation);
+	m_cameraCtrl.sendControl(control);
+}
+
+//------------------------------------------------------------------------
+
+void App::mergeFrame(ReceivedFrame& frame, std::vector<bool>& dirty, int& tileRowStart, int& tileRowEnd)
+{
+	const std::string& clientID = frame.server;
+	const FrameHeader& header = frame.header;
+	bool hasHeader = header.magic == FrameHeader::Magic;
+	int image_height = m_img.getSize().y;
+
+	// Frames rendered before the latest input was applied are dropped; the network
+	// thread filters too, but the epoch may have moved on since.
+	if (hasHeader && header.epoch != m_cameraCtrl.getEpoch())
+		return;
+
+	auto server = m_servers.find(clientID);
+	if (server == m_servers.end())
+		return;
+	m_heartbeats.recordTraffic(clientID, std::chrono::steady_clock::now());
+
+	// full resolution frames can stand in for a preview, but not the other way round
+	int scale = getFramePreviewScale(header.flags);
+	if (scale > 1 && scale != initState.m_preview.scale)
+		return;
+
+	if (hasHeader && header.tileId >= 0) {
+		if (!m_tileScheduler.isValidTile(header.tileId))
+			return;
+		const TileScheduler::Tile& t = m_tileScheduler.getTile(header.tileId);
+		if (t.y + t.height > image_height || header.width != (t.width + scale - 1) / scale || header.height != (t.height + scale - 1) / scale)
+			return;
+
+		// every pass over a tile adds to it, full frames count as m_spp_server samples
+		F64 samples = 0.0;
+		for (int i = 0; i < frame.decoder.getNumTiles(); ++i)
+		{
+			FrameTile tile = frame.decoder.getTile(i);
+			if (tile.weight == 0.0f)
+				tile.weight = (F32)m_spp_server;
+			samples += (F64)tile.width * tile.height * tile.weight;
+			if (scale > 1) {
+				m_pathtrace_renderer->addPreviewTile(t.x, t.y, scale, tile, frame.decoder, tile.weight);
+				continue;
+			}
+			tile.x += t.x;
+			m_pathtrace_renderer->addIndirectTile(t.y, tile, frame.decoder, tile.weight);
+		}
+		m_loadBalancer.recordFrame(clientID, samples);
+		m_tileScheduler.complete(header.tileId, clientID);
+		tileRowStart = min(tileRowStart, t.y);
+		tileRowEnd = max(tileRowEnd, t.y + t.height);
+		return;
+	}
+
+	int blockId = server->second;
+	if (blockId >= (int)m_strips.size())
+		return;
+
+	int vBlockStart = m_strips[blockId].vStart;
+	int vHeight = m_strips[blockId].vHeight;
+	if (vBlockStart + vHeight > image_height)
+		return;
+
+	// previews cover the rows of the strip that are multiples of the scale
+	int firstRow = (vBlockStart + scale - 1) / scale;
+	int numRows = (vBlockStart + vHeight + scale - 1) / scale - firstRow;
+
+	// Frames that do not match the strip (e.g. sent before a resize) are dropped.
+	if (!hasHeader) {
+		if (!frame.decoder.decode(frame.message.data(), frame.message.size(), m_img.getSize().x, vHeight))
+			return;
+	}
+	else if (header.width != (m_img.getSize().x + scale - 1) / scale || header.height != numRows)
+		return;
+
+	// Merge into the indirect buffer. Full frames replace the strip but count as the
+	// m_spp_server samples they hold, so they outweigh 1-spp local backfill passes.
+	F64 samples = 0.0;
+	F32 fullWeight = (F32)m_spp_server;
+	for (int i = 0; i < frame.decoder.getNumTiles(); ++i)
+	{
+		const FrameTile& tile = frame.decoder.getTile(i);
+		if (scale > 1)
+			m_pathtrace_renderer->addPreviewTile(0, firstRow * scale, scale, tile, frame.decoder, fullWeight);
+		else
+			m_pathtrace_renderer->addIndirectTile(vBlockStart, tile, frame.decoder, fullWeight);
+		samples += (F64)tile.width * tile.height * (tile.weight > 0.0f ? tile.weight : fullWeight);
+	}
+	m_loadBalancer.recordFrame(clientID, samples);
+	dirty[blockId] = true;
+}
+
+void App::syncTileScheduler()
+{
+	// tiles of an older epoch are worthless, start over
+	if (m_tileEpoch != m_cameraCtrl.getEpoch()) {
+		m_tileEpoch = m_cameraCtrl.getEpoch();
+		m_tileScheduler.reset(m_img.getSize(), initState.m_foveation);
+	}
+}
+
+void App::serveTileRequest(const std::string& clientID, U32 epoch)
+{
+	syncTileScheduler();
+	if (epoch != m_tileEpoch)
+		return;
+
+	TileScheduler::Tile tile;
+	WireTileAssignment assignment = { -1, 0, 0, 0, 0 };
+	if (m_tileScheduler.acquire(clientID, tile)) {
+		assignment.tileId = tile.id;
+		assignment.x = tile.x;
+		assignment.y = tile.y;
+		assignment.width = tile.width;
+		assignment.height = tile.height;
+	}
+
+	WireWriter frame;
+	writeWire(frame, assignment);
+	m_network.send(clientID, toMessage(frame, m_tileEpoch));
+}
+
+//------------------------------------------------------------------------
+
+// Serializes the mesh and its hierarchy for servers that do not have the scene files.
+// Servers cache assets by hash, so one that has seen this scene before fetches nothing.
+void App::publishAssets(const String& meshMD5)
+{
+	m_assets.clear(meshMD5);
+
+	MemoryOutputStream mesh;
+	exportBinaryMesh(mesh, m_mesh.get());
+	m_assets.add(WireAsset_Mesh, mesh.getData().getPtr(), mesh.getData().getSize());
+
+	std::ostringstream hierarchy(std::ios::binary);
+	m_rt->saveHierarchy(hierarchy);
+	const std::string& data = hierarchy.str();
+	m_assets.add(WireAsset_Hierarchy, data.data(), data.size());
+
+	FW::printf("Scene assets: %.1f MB mesh, %.1f MB hierarchy\n", mesh.getData().getSize() / 1048576.0f, data.size() / 1048576.0f);
+}
+
+// Older servers load the scene by name; newer ones fetch whatever the manifest lists that
+// they do not have cached.
+void App::writeScene(WireWriter& w) const
+{
+	WireScene scene = { m_scene };
+	writeWire(w, scene);
+	if (!m_assets.isEmpty())
+		m_assets.writeManifest(w);
 }
 
 
@@ -17,30 +17,65 @@
 
 #include "AreaLight.hpp"
 #include "PathTraceRenderer.hpp"
-
-#include <zmq.hpp>
+#include "TextureCache.hpp"
+#include "ShadingFrames.hpp"
+#include "FrameCodec.hpp"
+#include "LoadBalancer.hpp"
+#include "TileScheduler.hpp"
+#include "NetworkThread.hpp"
+#include "AssetStore.hpp"
+#include "HeartbeatMonitor.hpp"
+#include "LoopbackServer.hpp"
 
 
 namespace FW {
 
+// Server state last published on the input socket, replayed to servers that join later
+// together with the current camera, window size and scene.
 struct InitialState
 {
-    Vec3f m_position;
-    Vec3f m_forward;
-    Vec3f m_up;
-    Vec3f m_lightPosition;
-    Mat3f m_lightOrientation;
-    Vec2f m_size;
-    F32 m_fov;
-    bool m_RTMode = false;
-    bool m_JBF_server = false;
-    bool m_normalMapped = false;
-    bool m_useRussianRoulette = false;
-    int m_kernel = 6;
-    int m_spp_server = 4;
-    int m_numBounces = 1;
-    int m_blockId = 0;
-    int m_blockNum = 0;
+    WireLight m_light;
+    WireRenderSettings m_settings;
+    WireFoveation m_foveation;
+    WirePreview m_preview;
+
+    InitialState()
+    {
+        m_light.position = Vec3f(0.0f);
+        m_light.orientation.setIdentity();
+        m_settings.rtMode = false;
+        m_settings.jbf = false;
+        m_settings.normalMapped = false;
+        m_settings.russianRoulette = false;
+        m_settings.kernel = 6;
+        m_settings.spp = 4;
+        m_settings.numBounces = 1;
+        m_settings.frameEncoding = FrameEncoding_RGB32F;
+        m_settings.frameFlags = 0;
+        m_settings.pullTiles = false;
+        m_settings.framesInFlight = 0;
+        m_foveation.enabled = false;
+        m_foveation.focus = Vec2f(0.5f);
+        m_foveation.radius = 0.15f;
+        m_foveation.falloff = 0.15f;
+        m_foveation.minScale = 0.25f;
+        m_preview.scale = 1;
+    }
+};
+
+// Client-side network measurements, printed every second with -benchmark.
+struct NetBenchmark
+{
+    std::chrono::steady_clock::time_point start;
+    U32 frames = 0;             // merged, including ones the render loop found stale
+    U64 bytes = 0;
+    U32 latencies = 0;          // first frames of an epoch, see App::measureFrame
+    F64 latencySum = 0.0;
+    F64 latencyMax = 0.0;
+    U32 blends = 0;
+    F64 blendSeconds = 0.0;
+    U32 staleBase = 0;          // NetworkThread counters at the start of the period
+    U32 droppedBase = 0;
 };
 
 //------------------------------------------------------------------------
@@ -147,6 +182,25 @@ private:
 
 	void			blitRttToScreen(GLContext* gl);
 
+	void			sendAssignments	(void);
+	void			rebalance		(void);
+	void			removeServers	(const std::vector<std::string>& dead);
+	void			scheduleBackfill(void);
+	void			measureFrame	(const ReceivedFrame& frame);
+	void			returnCredits	(void);
+	void			reportBenchmark	(void);
+	void			serveTileRequest(const std::string& clientID, U32 epoch);
+	void			syncTileScheduler(void);
+	void			mergeFrame		(ReceivedFrame& frame, std::vector<bool>& dirty, int& tileRowStart, int& tileRowEnd);
+	void			publishAssets	(const String& meshMD5);
+	void			writeScene		(WireWriter& w) const;
+
+	U32				getFrameFlags	(void) const	{ return (m_frameDeflate ? FrameFlag_Deflate : 0) | (m_frameDelta ? FrameFlag_Delta : 0); }
+	WireRenderSettings getRenderSettings(void) const;
+	WireFoveation	getFoveation	(void) const;
+	void			updateFoveation	(void);
+	bool			updatePreview	(bool cameraMoved);
+
 private:
                     App             (const App&); // forbidden
     App&            operator=       (const App&); // forbidden
@@ -164,6 +218,8 @@ private:
     std::unique_ptr<RayTracer>			m_rt;
 	std::vector<Vec3f>				    m_rtVertexPositions; // kept only for MD5 checksums
     std::vector<RTTriangle>				m_rtTriangles;
+    TextureCache						m_textureCache;
+    ShadingFrames						m_shadingFrames;
 
     std::unique_ptr<MeshWithColors>     m_mesh;
 	std::unique_ptr<AreaLight>          m_areaLight;
@@ -178,6 +234,7 @@ private:
 
 	bool								clear_on_next_frame = false;
 	Mat4f								previous_camera = Mat4f(0);
+	std::chrono::steady_clock::time_point m_lastCameraMove;
 	Image								m_img;
 	int									m_numDebugPathCount = 1;
 	int									m_currentVisualizationIndex = 0;
@@ -192,21 +249,45 @@ private:
     int                                 m_kernel;
     int                                 m_spp;
     int                                 m_spp_server;
+    F32                                 m_exposure;
+    S32                                 m_tonemap;
+    S32                                 m_frameEncoding;
+    bool                                m_frameDeflate;
+    bool                                m_frameDelta;
+    bool                                m_pullTiles;
+    bool                                m_localBackfill;
+    bool                                m_foveated;
+    Vec2f                               m_focus;            // see WireFoveation
+    F32                                 m_foveaRadius;
+    F32                                 m_foveaFalloff;
+    F32                                 m_foveaMinScale;
+    S32                                 m_previewScale;     // while the camera moves
+    S32                                 m_framesInFlight;
+    bool                                m_pinThreads;       // render workers, see MulticoreLauncher::setPinThreads
 
 public:
-    zmq::context_t m_frameContext;
-    zmq::socket_t m_frameRouter;
-
-    zmq::context_t m_routerContext;
-    zmq::socket_t m_router;
+    NetworkThread m_network;
 
     String m_scene;
     InitialState initState;
 
     std::map<std::string, int> m_servers;
-    std::map<std::string, int> m_aliveServers;
-
-    std::chrono::steady_clock::time_point m_lastTimestamp;
+    HeartbeatMonitor m_heartbeats;
+
+    LoadBalancer m_loadBalancer;
+    std::vector<LoadBalancer::Strip> m_strips;  // indexed by block id
+    std::chrono::steady_clock::time_point m_lastRebalance;
+    U32 m_balancedEpoch = 0;
+    bool m_stripsPending = false;  // layout computed while servers pulled tiles, not sent yet
+
+    TileScheduler m_tileScheduler;  // pull mode only
+    std::map<std::string, U32> m_frameCredits;  // frames merged since credits were last returned
+    AssetStore m_assets;            // current mesh and hierarchy, for servers without the files
+
+    bool m_benchmark = false;
+    NetBenchmark m_bench;
+    std::vector<std::unique_ptr<LoopbackServer> > m_loopbackServers;  // -loopback N
+    U32 m_tileEpoch = ~0u;
 };
 
 
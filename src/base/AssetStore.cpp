@@ -0,0 +1,65 @@
+#include "AssetStore.hpp"
+#include "RayTracer.hpp"
+
+namespace FW {
+
+
+void AssetStore::clear(const String& meshMD5)
+{
+	m_meshMD5 = meshMD5;
+	m_assets.clear();
+}
+
+const AssetStore::Asset& AssetStore::add(WireAssetKind kind, const void* data, size_t size)
+{
+	// Chunk offsets and sizes go over the wire as 32 bits.
+	FW_ASSERT(size <= 0xFFFFFFFFu);
+
+	Asset asset;
+	asset.kind = kind;
+	asset.hash = RayTracer::computeMD5(data, size).getPtr();
+	asset.data.assign((const U8*)data, (const U8*)data + size);
+	m_assets.push_back(std::move(asset));
+	return m_assets.back();
+}
+
+const AssetStore::Asset* AssetStore::find(const std::string& hash) const
+{
+	for (const Asset& asset : m_assets)
+		if (asset.hash == hash)
+			return &asset;
+	return nullptr;
+}
+
+void AssetStore::writeManifest(WireWriter& w) const
+{
+	WireSceneManifest manifest;
+	manifest.meshMD5 = m_meshMD5;
+	for (const Asset& asset : m_assets)
+	{
+		WireAsset& a = manifest.assets.add();
+		a.kind = (U8)asset.kind;
+		a.hash = asset.hash.c_str();
+		a.size = (U32)asset.data.size();
+	}
+	writeWire(w, manifest);
+}
+
+bool AssetStore::serveRequest(const WireAssetRequest& request, WireWriter& reply) const
+{
+	const Asset* asset = find(request.hash.getPtr());
+	if (!asset || request.offset > asset->data.size())
+		return false;
+
+	WireAssetChunk chunk;
+	chunk.hash = request.hash;
+	chunk.offset = request.offset;
+	chunk.totalSize = (U32)asset->data.size();
+	chunk.size = (S32)min(min(request.size, (U32)WireMaxAssetChunk), chunk.totalSize - request.offset);
+	chunk.data = asset->data.data() + request.offset;
+	writeWire(reply, chunk);
+	return true;
+}
+
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+
+#include "base/Defs.hpp"
+#include "base/String.hpp"
+#include "io/WireProtocol.hpp"
+
+#include <string>
+#include <vector>
+
+
+namespace FW {
+
+
+// Scene data the client offers to render servers, so a new machine can join the pool without
+// a copy of the scene files or a hierarchy build of its own. Each asset is keyed by the MD5 of
+// its bytes; the manifest lists them, and servers fetch the ones missing from their cache in
+// chunks with WireMessage_AssetRequest.
+class AssetStore {
+public:
+	struct Asset {
+		WireAssetKind		kind;
+		std::string			hash;
+		std::vector<U8>		data;
+	};
+
+	// Forgets the assets of the previous scene.
+	void				clear				(const String& meshMD5);
+	const Asset&		add					(WireAssetKind kind, const void* data, size_t size);
+
+	bool				isEmpty				(void) const				{ return m_assets.empty(); }
+	const Asset*		find				(const std::string& hash) const;
+
+	void				writeManifest		(WireWriter& w) const;
+
+	// Appends the requested chunk, clamped to WireMaxAssetChunk. Returns false for unknown
+	// hashes, e.g. those of a scene replaced meanwhile; the server then waits for the new manifest.
+	bool				serveRequest		(const WireAssetRequest& request, WireWriter& reply) const;
+
+private:
+	String				m_meshMD5;
+	std::vector<Asset>	m_assets;	// A handful per scene.
+};
+
+
+}
@@ -0,0 +1,170 @@
+#include "Brdf.hpp"
+
+#include <emmintrin.h>
+#include <cstring>
+
+namespace FW {
+
+
+static const F32 s_revPI = 1.0f / FW_PI;
+
+// Diffuse energy scale between a smooth and a fully rough surface.
+static const F32 s_roughDiffuseScale = 1.0f / 1.51f;
+
+
+static inline F32 pow5(F32 x)
+{
+	F32 x2 = x * x;
+	return x2 * x2 * x;
+}
+
+static inline __m128 pow5(__m128 x)
+{
+	__m128 x2 = _mm_mul_ps(x, x);
+	return _mm_mul_ps(_mm_mul_ps(x2, x2), x);
+}
+
+static inline __m128 dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+static inline void normalize3(__m128& x, __m128& y, __m128& z)
+{
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(dot3(x, y, z, x, y, z)));
+	x = _mm_mul_ps(x, inv);
+	y = _mm_mul_ps(y, inv);
+	z = _mm_mul_ps(z, inv);
+}
+
+static inline __m128 saturate(__m128 x)
+{
+	return _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 absps(__m128 x)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+//------------------------------------------------------------------------
+
+BrdfBatch::BrdfBatch(void)
+{
+	// Lanes past count are evaluated too; keep them finite.
+	memset(this, 0, sizeof(*this));
+}
+
+int BrdfBatch::add(const Vec3f& diffuse, const Vec3f& specular, const Vec3f& n, const Vec3f& toLight, const Vec3f& toViewer, F32 glossiness)
+{
+	FW_ASSERT(count < Capacity);
+	int i = count++;
+
+	nx[i] = n.x;		ny[i] = n.y;		nz[i] = n.z;
+	lx[i] = toLight.x;	ly[i] = toLight.y;	lz[i] = toLight.z;
+	vx[i] = toViewer.x;	vy[i] = toViewer.y;	vz[i] = toViewer.z;
+
+	diffuseR[i] = diffuse.x;	diffuseG[i] = diffuse.y;	diffuseB[i] = diffuse.z;
+	specularR[i] = specular.x;	specularG[i] = specular.y;	specularB[i] = specular.z;
+	roughness[i] = glossinessToRoughness(glossiness);
+	return i;
+}
+
+//------------------------------------------------------------------------
+
+Vec3f evalBrdf(const Vec3f& diffuse, const Vec3f& specular, const Vec3f& n, const Vec3f& toLight, const Vec3f& toViewer, F32 glossiness)
+{
+	Vec3f L = toLight.normalized();
+	Vec3f V = toViewer.normalized();
+	Vec3f H = (V + L).normalized();
+
+	F32 NoV = FW::abs(FW::dot(n, V));
+	F32 NoL = FW::clamp(FW::dot(n, L), 0.0f, 1.0f);
+	F32 LoH = FW::clamp(FW::dot(L, H), 0.0f, 1.0f);
+	F32 NoH = FW::clamp(FW::dot(n, H), 0.0f, 1.0f);
+
+	F32 roughness = glossinessToRoughness(glossiness);
+	F32 fd90 = 0.6f * roughness + 2.f * LoH * LoH * roughness;
+	F32 lightScatter = 1.f + (fd90 - 1.f) * pow5(1.f - NoL);
+	F32 viewScatter = 1.f + (fd90 - 1.f) * pow5(1.f - NoV);
+	// there is a dark edge on object for this equation
+	Vec3f diffuseBRDF = diffuse * s_revPI * lightScatter * viewScatter * ((1 - roughness) + roughness * s_roughDiffuseScale);
+
+	Vec3f FS0 = (1 - roughness) * diffuse + roughness * (specular * specular) * 0.16f;
+	Vec3f F = FS0 + (fd90 - FS0) * pow5(1.f - LoH);
+	F32 alphaG2 = roughness * roughness;
+	F32 Lambda_GGXV = NoL * sqrt((-NoV * alphaG2 + NoV) * NoV + alphaG2);
+	F32 Lambda_GGXL = NoV * sqrt((-NoL * alphaG2 + NoL) * NoL + alphaG2);
+	F32 Vis = 0.5f / (Lambda_GGXV + Lambda_GGXL);
+	F32 f = (NoH * alphaG2 - NoH) * NoH + 1;
+	F32 D = alphaG2 / (f * f);
+	Vec3f specularBRDF = D * F * Vis * s_revPI;
+
+	return diffuseBRDF + specularBRDF;
+}
+
+void evalBrdfBatch(BrdfBatch& b)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 revPI = _mm_set1_ps(s_revPI);
+
+	for (int i = 0; i < b.count; i += 4)
+	{
+		__m128 nx = _mm_load_ps(&b.nx[i]), ny = _mm_load_ps(&b.ny[i]), nz = _mm_load_ps(&b.nz[i]);
+		__m128 lx = _mm_load_ps(&b.lx[i]), ly = _mm_load_ps(&b.ly[i]), lz = _mm_load_ps(&b.lz[i]);
+		__m128 vx = _mm_load_ps(&b.vx[i]), vy = _mm_load_ps(&b.vy[i]), vz = _mm_load_ps(&b.vz[i]);
+
+		normalize3(lx, ly, lz);
+		normalize3(vx, vy, vz);
+		__m128 hx = _mm_add_ps(vx, lx), hy = _mm_add_ps(vy, ly), hz = _mm_add_ps(vz, lz);
+		normalize3(hx, hy, hz);
+
+		__m128 NoV = absps(dot3(nx, ny, nz, vx, vy, vz));
+		__m128 NoL = saturate(dot3(nx, ny, nz, lx, ly, lz));
+		__m128 LoH = saturate(dot3(lx, ly, lz, hx, hy, hz));
+		__m128 NoH = saturate(dot3(nx, ny, nz, hx, hy, hz));
+
+		__m128 r = _mm_load_ps(&b.roughness[i]);
+		__m128 smooth = _mm_sub_ps(one, r);
+
+		// Diffuse: one scalar factor per lane, times albedo.
+		__m128 fd90 = _mm_mul_ps(r, _mm_add_ps(_mm_set1_ps(0.6f), _mm_mul_ps(two, _mm_mul_ps(LoH, LoH))));
+		__m128 fd90m1 = _mm_sub_ps(fd90, one);
+		__m128 lightScatter = _mm_add_ps(one, _mm_mul_ps(fd90m1, pow5(_mm_sub_ps(one, NoL))));
+		__m128 viewScatter = _mm_add_ps(one, _mm_mul_ps(fd90m1, pow5(_mm_sub_ps(one, NoV))));
+		__m128 kd = _mm_mul_ps(_mm_mul_ps(revPI, _mm_mul_ps(lightScatter, viewScatter)),
+			_mm_add_ps(smooth, _mm_mul_ps(r, _mm_set1_ps(s_roughDiffuseScale))));
+
+		// Specular: D * Vis / PI per lane, times the per-channel Fresnel term.
+		__m128 alphaG2 = _mm_mul_ps(r, r);
+		__m128 lambdaV = _mm_mul_ps(NoL, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(NoV, _mm_mul_ps(NoV, alphaG2)), NoV), alphaG2)));
+		__m128 lambdaL = _mm_mul_ps(NoV, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(NoL, _mm_mul_ps(NoL, alphaG2)), NoL), alphaG2)));
+		__m128 vis = _mm_div_ps(half, _mm_add_ps(lambdaV, lambdaL));
+		__m128 f = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(NoH, alphaG2), NoH), NoH), one);
+		__m128 D = _mm_div_ps(alphaG2, _mm_mul_ps(f, f));
+		__m128 ks = _mm_mul_ps(_mm_mul_ps(D, vis), revPI);
+
+		__m128 fresnel = pow5(_mm_sub_ps(one, LoH));
+		__m128 specScale = _mm_mul_ps(r, _mm_set1_ps(0.16f));
+
+#define FW_BRDF_CHANNEL(DIFFUSE, SPECULAR, RESULT) \
+		{ \
+			__m128 albedo = _mm_load_ps(&b.DIFFUSE[i]); \
+			__m128 spec = _mm_load_ps(&b.SPECULAR[i]); \
+			__m128 FS0 = _mm_add_ps(_mm_mul_ps(smooth, albedo), _mm_mul_ps(specScale, _mm_mul_ps(spec, spec))); \
+			__m128 F = _mm_add_ps(FS0, _mm_mul_ps(_mm_sub_ps(fd90, FS0), fresnel)); \
+			_mm_store_ps(&b.RESULT[i], _mm_add_ps(_mm_mul_ps(albedo, kd), _mm_mul_ps(F, ks))); \
+		}
+
+		FW_BRDF_CHANNEL(diffuseR, specularR, resultR)
+		FW_BRDF_CHANNEL(diffuseG, specularG, resultG)
+		FW_BRDF_CHANNEL(diffuseB, specularB, resultB)
+
+#undef FW_BRDF_CHANNEL
+	}
+}
+
+
+}
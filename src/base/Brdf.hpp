@@ -0,0 +1,54 @@
+#pragma once
+
+
+#include "base/Math.hpp"
+
+
+namespace FW {
+
+
+// Inputs and outputs for evaluating the renderer's BRDF (Disney diffuse plus GGX specular)
+// at many shading points at once. Stored as structure of arrays so the evaluation runs
+// four points per SSE instruction. Every material goes through the same code path, so
+// batches need no sorting by material to stay coherent.
+struct BrdfBatch {
+	enum { Capacity = 64 };	// Multiple of the SIMD width.
+
+	int		count;
+
+	// Shading normal (normalized), direction to the light and direction to the viewer
+	// (both unnormalized).
+	alignas(16) F32 nx[Capacity], ny[Capacity], nz[Capacity];
+	alignas(16) F32 lx[Capacity], ly[Capacity], lz[Capacity];
+	alignas(16) F32 vx[Capacity], vy[Capacity], vz[Capacity];
+
+	alignas(16) F32 diffuseR[Capacity], diffuseG[Capacity], diffuseB[Capacity];
+	alignas(16) F32 specularR[Capacity], specularG[Capacity], specularB[Capacity];
+	alignas(16) F32 roughness[Capacity];
+
+	// Written by evalBrdfBatch.
+	alignas(16) F32 resultR[Capacity], resultG[Capacity], resultB[Capacity];
+
+			BrdfBatch		(void);
+
+	bool	isFull			(void) const	{ return count == Capacity; }
+	void	clear			(void)			{ count = 0; }
+
+	// Appends a shading point and returns its index. Arguments match evalBrdf.
+	int		add				(const Vec3f& diffuse, const Vec3f& specular, const Vec3f& n, const Vec3f& toLight, const Vec3f& toViewer, F32 glossiness);
+
+	Vec3f	getResult		(int i) const	{ return Vec3f(resultR[i], resultG[i], resultB[i]); }
+};
+
+
+// Roughness used by the BRDF for a material glossiness in [0, 255].
+inline F32	glossinessToRoughness	(F32 glossiness)	{ return 1.0f - glossiness / 255.0f; }
+
+// Scalar reference evaluation for a single shading point.
+Vec3f		evalBrdf				(const Vec3f& diffuse, const Vec3f& specular, const Vec3f& n, const Vec3f& toLight, const Vec3f& toViewer, F32 glossiness);
+
+// Evaluates all points in the batch into the result arrays.
+void		evalBrdfBatch			(BrdfBatch& batch);
+
+
+}
@@ -0,0 +1,144 @@
+#include "ColorTransform.hpp"
+
+#include "gui/Image.hpp"
+
+#include <emmintrin.h>
+
+namespace FW {
+
+
+static const F32 s_displayGamma = 2.2f;
+
+// 8-bit -> linear lookup, built once at startup.
+static struct GammaTable {
+	F32 decode[256];
+
+	GammaTable() {
+		for (int i = 0; i < 256; ++i)
+			decode[i] = powf(i / 255.0f, s_displayGamma);
+	}
+} s_gammaTable;
+
+
+// log2 for positive, normal x: exponent from the float bits plus a degree 5 minimax
+// polynomial on the mantissa in [1, 2).
+static inline __m128 log2Approx(__m128 x)
+{
+	__m128i bits = _mm_castps_si128(x);
+	__m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x7f800000)), 23), _mm_set1_epi32(127)));
+	__m128 m = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff))), _mm_set1_ps(1.0f));
+
+	__m128 p = _mm_set1_ps(0.0596515482674574969533f);
+	p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(-0.465725644288844778798f));
+	p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.48116647521213171641f));
+	p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(-2.52074962577807006663f));
+	p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(2.8882704548164776201f));
+	p = _mm_mul_ps(p, _mm_sub_ps(m, _mm_set1_ps(1.0f)));
+
+	return _mm_add_ps(p, e);
+}
+
+// exp2: integer part goes straight into the exponent bits, fractional part through a degree 5 polynomial.
+static inline __m128 exp2Approx(__m128 x)
+{
+	x = _mm_min_ps(x, _mm_set1_ps(127.99999f));
+	x = _mm_max_ps(x, _mm_set1_ps(-126.99999f));
+
+	__m128i ipart = _mm_cvtps_epi32(_mm_sub_ps(x, _mm_set1_ps(0.5f)));
+	__m128 fpart = _mm_sub_ps(x, _mm_cvtepi32_ps(ipart));
+	__m128 expipart = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(ipart, _mm_set1_epi32(127)), 23));
+
+	__m128 p = _mm_set1_ps(1.8775767e-3f);
+	p = _mm_add_ps(_mm_mul_ps(p, fpart), _mm_set1_ps(8.9893397e-3f));
+	p = _mm_add_ps(_mm_mul_ps(p, fpart), _mm_set1_ps(5.5826318e-2f));
+	p = _mm_add_ps(_mm_mul_ps(p, fpart), _mm_set1_ps(2.4015361e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, fpart), _mm_set1_ps(6.9315308e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, fpart), _mm_set1_ps(9.9999994e-1f));
+
+	return _mm_mul_ps(expipart, p);
+}
+
+// x^y for x > 0; zero for x <= 0.
+static inline __m128 powApprox(__m128 x, __m128 y)
+{
+	__m128 positive = _mm_cmpgt_ps(x, _mm_setzero_ps());
+	return _mm_and_ps(positive, exp2Approx(_mm_mul_ps(log2Approx(x), y)));
+}
+
+static inline __m128 applyTonemap(__m128 c, Tonemap tonemap)
+{
+	switch (tonemap)
+	{
+	case Tonemap_Reinhard:
+		return _mm_div_ps(c, _mm_add_ps(c, _mm_set1_ps(1.0f)));
+
+	case Tonemap_ACES:
+	{
+		__m128 num = _mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(2.51f)), _mm_set1_ps(0.03f)));
+		__m128 den = _mm_add_ps(_mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(2.43f)), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+		return _mm_min_ps(_mm_max_ps(_mm_div_ps(num, den), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	}
+
+	default:
+		return c;
+	}
+}
+
+void resolveRow(Vec4f* dst, const Vec4f* src, int width, const ResolveParams& params)
+{
+	const __m128 wMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 exposure = _mm_set1_ps(params.exposure);
+	const __m128 invGamma = _mm_set1_ps(1.0f / s_displayGamma);
+
+	for (int j = 0; j < width; ++j)
+	{
+		__m128 v = _mm_loadu_ps(&src[j].x);
+
+		// Normalize by the sample weight, leaving empty pixels untouched.
+		__m128 w = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+		__m128 hasSamples = _mm_cmpneq_ps(w, _mm_setzero_ps());
+		__m128 scaled = _mm_mul_ps(v, _mm_div_ps(one, w));
+		v = _mm_or_ps(_mm_and_ps(hasSamples, scaled), _mm_andnot_ps(hasSamples, v));
+
+		__m128 c = applyTonemap(_mm_mul_ps(v, exposure), params.tonemap);
+		c = powApprox(c, invGamma);
+
+		_mm_storeu_ps(&dst[j].x, _mm_or_ps(_mm_andnot_ps(wMask, c), _mm_and_ps(wMask, v)));
+	}
+}
+
+Vec3f decodeGamma(const Vec3f& encoded)
+{
+	Vec4f result;
+	_mm_storeu_ps(&result.x, powApprox(_mm_setr_ps(encoded.x, encoded.y, encoded.z, 0.0f), _mm_set1_ps(s_displayGamma)));
+	return result.getXYZ();
+}
+
+F32 decodeGamma8(U8 encoded)
+{
+	return s_gammaTable.decode[encoded];
+}
+
+Vec3f fetchLinearTexel(const Image& image, const Vec2i& pos)
+{
+	switch (image.getFormat().getID())
+	{
+	case ImageFormat::RGB_Vec3f:
+	case ImageFormat::RGBA_Vec4f:
+	case ImageFormat::A_F32:
+		return decodeGamma(image.getVec4f(pos).getXYZ());
+
+	default:
+	{
+		U32 abgr = image.getABGR(pos);
+		return Vec3f(
+			decodeGamma8((U8)abgr),
+			decodeGamma8((U8)(abgr >> 8)),
+			decodeGamma8((U8)(abgr >> 16)));
+	}
+	}
+}
+
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+
+#include "base/Math.hpp"
+
+
+namespace FW {
+
+
+class Image;
+
+
+// Display transforms applied after the radiance has been normalized by its sample weight.
+enum Tonemap {
+	Tonemap_None = 0,	// Linear, values above one clip on display.
+	Tonemap_Reinhard,	// x / (1 + x) per channel.
+	Tonemap_ACES		// Narkowicz's fit of the ACES filmic curve.
+};
+
+struct ResolveParams {
+	F32		exposure;	// Linear scale applied before tonemapping.
+	Tonemap	tonemap;
+
+	ResolveParams() : exposure(1.0f), tonemap(Tonemap_None) {}
+};
+
+
+// All colour transforms use the same 2.2 display gamma as the rest of the renderer.
+// Float conversions use a SIMD log2/exp2 polynomial (relative error below 1e-4) instead of powf;
+// 8-bit conversions go through a 256-entry table.
+
+// Normalizes accumulated radiance by w, applies exposure and tonemapping and gamma encodes
+// the result for display. w is written out as 1, or 0 for pixels without samples.
+// In-place operation (dst == src) is allowed.
+void	resolveRow			(Vec4f* dst, const Vec4f* src, int width, const ResolveParams& params);
+
+Vec3f	decodeGamma			(const Vec3f& encoded);
+F32		decodeGamma8		(U8 encoded);
+
+// Fetches a texel and converts it to linear colour. 8-bit textures use the lookup table,
+// float textures the polynomial.
+Vec3f	fetchLinearTexel	(const Image& image, const Vec2i& pos);
+
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+
+#include "base/Math.hpp"
+#include "io/WireProtocol.hpp"
+
+
+namespace FW {
+
+
+// Region-of-interest weighting for foveated rendering, shared by the client and servers.
+// Blocks and tiles are rated by their pixel nearest to the WireFoveation focus, so one that
+// touches the fovea gets the full rate. Work is handed out in order of decreasing priority
+// and its sample count scaled down towards minScale in the periphery.
+
+// 1 inside the fovea, falling smoothly to 0 over the falloff; always 1 when disabled.
+inline F32 getFoveaPriority(const WireFoveation& f, const Vec2i& imageSize, int x, int y, int width, int height)
+{
+	if (!f.enabled || imageSize.y <= 0)
+		return 1.0f;
+
+	Vec2f focus = f.focus * Vec2f(imageSize);
+	Vec2f nearest(clamp(focus.x, (F32)x, (F32)(x + width)), clamp(focus.y, (F32)y, (F32)(y + height)));
+	F32 d = (nearest - focus).length() / (F32)imageSize.y;
+	F32 t = clamp((d - f.radius) / max(f.falloff, 1.0e-3f), 0.0f, 1.0f);
+	return 1.0f - t * t * (3.0f - 2.0f * t);
+}
+
+// Samples per pixel for work of the given priority, at least one.
+inline int getFoveatedSamples(const WireFoveation& f, int spp, F32 priority)
+{
+	if (!f.enabled)
+		return spp;
+	F32 scale = lerp(clamp(f.minScale, 0.0f, 1.0f), 1.0f, priority);
+	return max((int)(spp * scale + 0.5f), 1);
+}
+
+
+}
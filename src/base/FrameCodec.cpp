@@ -0,0 +1,532 @@
+#include "FrameCodec.hpp"
+#include "3rdparty/lodepng/lodepng.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace FW {
+
+
+static inline U32 floatBits(F32 f)	{ U32 u; memcpy(&u, &f, 4); return u; }
+static inline F32 bitsFloat(U32 u)	{ F32 f; memcpy(&f, &u, 4); return f; }
+
+// Radiance is never negative; NaNs from degenerate samples become zero instead of
+// poisoning the client's accumulation.
+static inline F32 sanitize(F32 v)	{ return (v > 0.0f) ? v : 0.0f; }
+
+//------------------------------------------------------------------------
+// IEEE half, round to nearest, values past the half range clamp to the largest finite half.
+
+static inline U16 floatToHalf(F32 f)
+{
+	U32 u = floatBits(sanitize(f));
+	if (u >= 0x477FF000u)			// >= 65520 rounds past the largest half.
+		return 0x7BFF;
+	if (u < 0x38800000u)			// Below the smallest normal half: denormal or zero.
+	{
+		if (u < 0x33000000u)
+			return 0;
+		U32 mant = (u & 0x007FFFFFu) | 0x00800000u;
+		int shift = 126 - (int)(u >> 23);
+		U32 half = mant >> shift;
+		U32 rem = mant & ((1u << shift) - 1);
+		U32 mid = 1u << (shift - 1);
+		if (rem > mid || (rem == mid && (half & 1)))
+			++half;
+		return (U16)half;
+	}
+	U32 half = ((u - 0x38000000u) >> 13);
+	U32 rem = u & 0x1FFFu;
+	if (rem > 0x1000u || (rem == 0x1000u && (half & 1)))
+		++half;
+	return (U16)half;
+}
+
+static inline F32 halfToFloat(U16 h)
+{
+	U32 exp = (h >> 10) & 0x1F;
+	U32 mant = h & 0x3FF;
+	if (exp == 0)
+		return (F32)mant * (1.0f / (1 << 24));
+	if (exp == 31)
+		return bitsFloat(0x7F800000u | (mant << 13));
+	return bitsFloat(((exp + 112) << 23) | (mant << 13));
+}
+
+//------------------------------------------------------------------------
+// RGB9E5 as in EXT_texture_shared_exponent.
+
+static const int	s_e5Bias		= 15;
+static const int	s_e5MantBits	= 9;
+static const F32	s_e5Max			= (F32)((1 << s_e5MantBits) - 1) / (1 << s_e5MantBits) * (F32)(1 << (31 - s_e5Bias));
+
+static inline U32 encodeRGB9E5(F32 r, F32 g, F32 b)
+{
+	r = std::min(sanitize(r), s_e5Max);
+	g = std::min(sanitize(g), s_e5Max);
+	b = std::min(sanitize(b), s_e5Max);
+	F32 maxc = std::max(r, std::max(g, b));
+
+	int exp = std::max(-s_e5Bias - 1, (int)floorf(log2f(std::max(maxc, 1e-30f)))) + 1 + s_e5Bias;
+	F32 scale = ldexpf(1.0f, s_e5MantBits - (exp - s_e5Bias));
+	if ((int)floorf(maxc * scale + 0.5f) == (1 << s_e5MantBits))
+	{
+		scale *= 0.5f;
+		++exp;
+	}
+
+	U32 rm = (U32)floorf(r * scale + 0.5f);
+	U32 gm = (U32)floorf(g * scale + 0.5f);
+	U32 bm = (U32)floorf(b * scale + 0.5f);
+	return rm | (gm << 9) | (bm << 18) | ((U32)exp << 27);
+}
+
+static inline void decodeRGB9E5(U32 v, F32* rgb)
+{
+	F32 scale = ldexpf(1.0f, (int)(v >> 27) - s_e5Bias - s_e5MantBits);
+	rgb[0] = (F32)(v & 0x1FF) * scale;
+	rgb[1] = (F32)((v >> 9) & 0x1FF) * scale;
+	rgb[2] = (F32)((v >> 18) & 0x1FF) * scale;
+}
+
+//------------------------------------------------------------------------
+// RGBE as in the Radiance HDR format.
+
+static inline void encodeRGBE(F32 r, F32 g, F32 b, U8* out)
+{
+	r = sanitize(r); g = sanitize(g); b = sanitize(b);
+	F32 maxc = std::max(r, std::max(g, b));
+	if (maxc < 1e-32f)
+	{
+		out[0] = out[1] = out[2] = out[3] = 0;
+		return;
+	}
+
+	int exp;
+	F32 scale = frexpf(maxc, &exp) * 256.0f / maxc;
+	out[0] = (U8)std::min(r * scale, 255.0f);
+	out[1] = (U8)std::min(g * scale, 255.0f);
+	out[2] = (U8)std::min(b * scale, 255.0f);
+	out[3] = (U8)std::min(exp + 128, 255);
+}
+
+static inline void decodeRGBE(const U8* in, F32* rgb)
+{
+	if (in[3] == 0)
+	{
+		rgb[0] = rgb[1] = rgb[2] = 0.0f;
+		return;
+	}
+	F32 scale = ldexpf(1.0f, (int)in[3] - (128 + 8));
+	rgb[0] = ((F32)in[0] + 0.5f) * scale;
+	rgb[1] = ((F32)in[1] + 0.5f) * scale;
+	rgb[2] = ((F32)in[2] + 0.5f) * scale;
+}
+
+//------------------------------------------------------------------------
+
+const char* getFrameEncodingName(FrameEncoding encoding)
+{
+	switch (encoding)
+	{
+	case FrameEncoding_RGB32F:	return "RGB32F";
+	case FrameEncoding_RGB16F:	return "RGB16F";
+	case FrameEncoding_RGB9E5:	return "RGB9E5";
+	case FrameEncoding_RGBE:	return "RGBE";
+	default:					return "unknown";
+	}
+}
+
+int getFrameEncodingStride(FrameEncoding encoding)
+{
+	switch (encoding)
+	{
+	case FrameEncoding_RGB32F:	return 12;
+	case FrameEncoding_RGB16F:	return 6;
+	case FrameEncoding_RGB9E5:	return 4;
+	case FrameEncoding_RGBE:	return 4;
+	default:					return 0;
+	}
+}
+
+static void encodePixels(U8* dst, const F32* rgb, size_t numPixels, FrameEncoding encoding)
+{
+	switch (encoding)
+	{
+	case FrameEncoding_RGB32F:
+		memcpy(dst, rgb, numPixels * 12);
+		break;
+
+	case FrameEncoding_RGB16F:
+		for (size_t i = 0; i < numPixels * 3; ++i)
+		{
+			U16 h = floatToHalf(rgb[i]);
+			memcpy(dst + i * 2, &h, 2);
+		}
+		break;
+
+	case FrameEncoding_RGB9E5:
+		for (size_t i = 0; i < numPixels; ++i)
+		{
+			U32 v = encodeRGB9E5(rgb[i * 3 + 0], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+			memcpy(dst + i * 4, &v, 4);
+		}
+		break;
+
+	case FrameEncoding_RGBE:
+		for (size_t i = 0; i < numPixels; ++i)
+			encodeRGBE(rgb[i * 3 + 0], rgb[i * 3 + 1], rgb[i * 3 + 2], dst + i * 4);
+		break;
+
+	default:
+		FW_ASSERT(false);
+	}
+}
+
+//------------------------------------------------------------------------
+
+// Fills in the header and appends the payload, deflating it if requested.
+static void packFrame(std::vector<U8>& out, FrameHeader header, const std::vector<U8>& raw)
+{
+	const std::vector<U8>* payload = &raw;
+	std::vector<U8> packed;
+
+	if (header.flags & FrameFlag_Deflate)
+	{
+		// Fall back to the uncompressed payload rather than dropping the frame.
+		if (LodePNG::compress(packed, raw) == 0)
+			payload = &packed;
+		else
+			header.flags &= ~FrameFlag_Deflate;
+	}
+
+	header.magic = FrameHeader::Magic;
+	header.reserved = 0;
+	header.payloadSize = (U32)payload->size();
+
+	out.resize(sizeof(FrameHeader) + payload->size());
+	memcpy(out.data(), &header, sizeof(FrameHeader));
+	if (!payload->empty())
+		memcpy(out.data() + sizeof(FrameHeader), payload->data(), payload->size());
+}
+
+void encodeFrame(std::vector<U8>& out, const F32* rgb, int width, int height, FrameEncoding encoding, U32 flags, U32 epoch, S32 tileId)
+{
+	FW_ASSERT(width >= 0 && height >= 0);
+	FW_ASSERT(encoding >= 0 && encoding < FrameEncoding_Max);
+
+	size_t numPixels = (size_t)width * height;
+	std::vector<U8> raw(numPixels * getFrameEncodingStride(encoding));
+	encodePixels(raw.data(), rgb, numPixels, encoding);
+
+	FrameHeader header;
+	header.encoding = (U8)encoding;
+	header.flags = (U8)(flags & ~FrameFlag_Delta);
+	header.width = width;
+	header.height = height;
+	header.epoch = epoch;
+	header.tileId = tileId;
+	packFrame(out, header, raw);
+}
+
+bool peekFrameHeader(const void* data, size_t size, FrameHeader& header)
+{
+	if (size < sizeof(FrameHeader))
+		return false;
+	memcpy(&header, data, sizeof(FrameHeader));
+	return header.magic == FrameHeader::Magic;
+}
+
+//------------------------------------------------------------------------
+
+FrameDeltaEncoder::FrameDeltaEncoder(void)
+:	m_width		(0),
+	m_height	(0),
+	m_tilesX	(0),
+	m_threshold	(0.01f)
+{
+}
+
+void FrameDeltaEncoder::reset(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_tilesX = (width + FrameTileSize - 1) / FrameTileSize;
+	int tilesY = (height + FrameTileSize - 1) / FrameTileSize;
+
+	m_sent.assign((size_t)width * height * 3, 0.0f);
+	m_pending.assign((size_t)width * height * 3, 0.0f);
+	m_sentWeight.assign((size_t)m_tilesX * tilesY, 0.0f);
+	m_pendingWeight.assign((size_t)m_tilesX * tilesY, 0.0f);
+}
+
+void FrameDeltaEncoder::addPass(const F32* rgb, F32 weight)
+{
+	FW_ASSERT(weight > 0.0f);
+	for (size_t i = 0; i < m_pending.size(); ++i)
+		m_pending[i] += sanitize(rgb[i]) * weight;
+	for (size_t i = 0; i < m_pendingWeight.size(); ++i)
+		m_pendingWeight[i] += weight;
+}
+
+bool FrameDeltaEncoder::encode(std::vector<U8>& out, FrameEncoding encoding, U32 flags, U32 epoch, S32 tileId)
+{
+	FW_ASSERT(encoding >= 0 && encoding < FrameEncoding_Max);
+
+	int stride = getFrameEncodingStride(encoding);
+	std::vector<U8> raw(sizeof(U32));
+	std::vector<F32> mean;
+	U32 numTiles = 0;
+
+	for (int t = 0; t < (int)m_pendingWeight.size(); ++t)
+	{
+		F32 pendingWeight = m_pendingWeight[t];
+		if (pendingWeight <= 0.0f)
+			continue;
+
+		int x0 = (t % m_tilesX) * FrameTileSize;
+		int y0 = (t / m_tilesX) * FrameTileSize;
+		int w = std::min((int)FrameTileSize, m_width - x0);
+		int h = std::min((int)FrameTileSize, m_height - y0);
+		F32 sentWeight = m_sentWeight[t];
+
+		// Mean absolute change the pending samples would make to the client's estimate,
+		// relative to the tile's mean brightness. Tiles never sent always go out.
+		if (sentWeight > 0.0f)
+		{
+			F32 change = 0.0f, level = 0.0f;
+			F32 totalWeight = sentWeight + pendingWeight;
+			for (int y = y0; y < y0 + h; ++y)
+			for (int x = x0; x < x0 + w; ++x)
+			for (int c = 0; c < 3; ++c)
+			{
+				size_t i = ((size_t)y * m_width + x) * 3 + c;
+				F32 before = m_sent[i] / sentWeight;
+				F32 after = (m_sent[i] + m_pending[i]) / totalWeight;
+				change += fabsf(after - before);
+				level += after;
+			}
+			if (change <= m_threshold * level)
+				continue;
+		}
+
+		FrameTileHeader tile;
+		tile.x = (U16)x0;
+		tile.y = (U16)y0;
+		tile.width = (U16)w;
+		tile.height = (U16)h;
+		tile.weight = pendingWeight;
+
+		// Tiles carry the mean of their new samples; the client rescales by weight.
+		mean.resize((size_t)w * h * 3);
+		for (int y = 0; y < h; ++y)
+		for (int x = 0; x < w * 3; ++x)
+		{
+			size_t i = ((size_t)(y0 + y) * m_width + x0) * 3 + x;
+			mean[(size_t)y * w * 3 + x] = m_pending[i] / pendingWeight;
+			m_sent[i] += m_pending[i];
+			m_pending[i] = 0.0f;
+		}
+		m_sentWeight[t] += pendingWeight;
+		m_pendingWeight[t] = 0.0f;
+
+		size_t offset = raw.size();
+		raw.resize(offset + sizeof(FrameTileHeader) + (size_t)w * h * stride);
+		memcpy(&raw[offset], &tile, sizeof(FrameTileHeader));
+		encodePixels(&raw[offset + sizeof(FrameTileHeader)], mean.data(), (size_t)w * h, encoding);
+		++numTiles;
+	}
+
+	if (numTiles == 0)
+		return false;
+	memcpy(raw.data(), &numTiles, sizeof(U32));
+
+	FrameHeader header;
+	header.encoding = (U8)encoding;
+	header.flags = (U8)(flags | FrameFlag_Delta);
+	header.width = m_width;
+	header.height = m_height;
+	header.epoch = epoch;
+	header.tileId = tileId;
+	packFrame(out, header, raw);
+	return true;
+}
+
+//------------------------------------------------------------------------
+
+bool FrameDecoder::decode(const void* data, size_t size)
+{
+	FrameHeader header;
+	if (!peekFrameHeader(data, size, header))
+	{
+		m_tiles.clear();
+		return false;
+	}
+	return decode(data, size, header.width, header.height);
+}
+
+bool FrameDecoder::decode(const void* data, size_t size, int width, int height)
+{
+	m_tiles.clear();
+
+	size_t numPixels = (size_t)width * height;
+	const U8* bytes = (const U8*)data;
+
+	FrameHeader header;
+	if (size < sizeof(FrameHeader) || (memcpy(&header, bytes, sizeof(FrameHeader)), header.magic != FrameHeader::Magic))
+	{
+		// Legacy server: bare pColor array.
+		if (size != numPixels * 12)
+			return false;
+		m_payload = bytes;
+		m_encoding = FrameEncoding_RGB32F;
+		addTile(0, 0, width, height, 0.0f, 0);
+		return true;
+	}
+
+	if (header.width != width || header.height != height || header.encoding >= FrameEncoding_Max)
+		return false;
+	if (size != sizeof(FrameHeader) + header.payloadSize)
+		return false;
+
+	FrameEncoding encoding = (FrameEncoding)header.encoding;
+	int stride = getFrameEncodingStride(encoding);
+	const U8* payload = bytes + sizeof(FrameHeader);
+	size_t payloadSize = header.payloadSize;
+
+	if (header.flags & FrameFlag_Deflate)
+	{
+		// Never inflate past the largest valid payload, so a corrupt or hostile stream
+		// cannot make us allocate without bound: every pixel once, plus for delta
+		// frames the tile count and a header for each tile of the grid.
+		LodePNG_DecompressSettings settings;
+		LodePNG_DecompressSettings_init(&settings);
+		settings.maxOutputSize = std::max(numPixels * stride, (size_t)1); // 0 would mean no limit.
+		if (header.flags & FrameFlag_Delta)
+		{
+			size_t maxTiles = (size_t)((width + FrameTileSize - 1) / FrameTileSize) * ((height + FrameTileSize - 1) / FrameTileSize);
+			settings.maxOutputSize += sizeof(U32) + maxTiles * sizeof(FrameTileHeader);
+		}
+
+		m_inflated.clear();
+		if (LodePNG::decompress(m_inflated, payload, payloadSize, settings) != 0)
+			return false;
+		payload = m_inflated.data();
+		payloadSize = m_inflated.size();
+	}
+	m_payload = payload;
+	m_encoding = encoding;
+
+	if (!(header.flags & FrameFlag_Delta))
+	{
+		if (payloadSize != numPixels * stride)
+			return false;
+		addTile(0, 0, width, height, 0.0f, 0);
+		return true;
+	}
+
+	// Delta frame: validate the whole tile list before decoding any of it.
+	U32 numTiles;
+	if (payloadSize < sizeof(U32))
+		return false;
+	memcpy(&numTiles, payload, sizeof(U32));
+
+	size_t offset = sizeof(U32);
+	for (U32 i = 0; i < numTiles; ++i)
+	{
+		FrameTileHeader tile;
+		if (offset + sizeof(FrameTileHeader) > payloadSize)
+			return false;
+		memcpy(&tile, payload + offset, sizeof(FrameTileHeader));
+		if (tile.x + tile.width > width || tile.y + tile.height > height || !(tile.weight > 0.0f))
+			return false;
+
+		size_t tilePixels = (size_t)tile.width * tile.height;
+		offset += sizeof(FrameTileHeader);
+		addTile(tile.x, tile.y, tile.width, tile.height, tile.weight, offset);
+		offset += tilePixels * stride;
+		if (offset > payloadSize)
+			return false;
+	}
+	if (offset != payloadSize)
+		return false;
+	return true;
+}
+
+// One row from the encoded payload into the accumulation buffer, without a staging copy.
+template <class Decode>
+static inline void accumulatePixels(Vec4f* dst, const U8* src, int width, int stride, F32 weight, F32 replaceWeight, Decode decode)
+{
+	F32 rgb[3];
+	if (weight == 0.0f)
+	{
+		for (int j = 0; j < width; ++j, src += stride)
+		{
+			decode(src, rgb);
+			dst[j] = Vec4f(rgb[0] * replaceWeight, rgb[1] * replaceWeight, rgb[2] * replaceWeight, replaceWeight);
+		}
+	}
+	else
+	{
+		for (int j = 0; j < width; ++j, src += stride)
+		{
+			decode(src, rgb);
+			dst[j] += Vec4f(rgb[0] * weight, rgb[1] * weight, rgb[2] * weight, weight);
+		}
+	}
+}
+
+void FrameDecoder::accumulateRow(const FrameTile& tile, int y, Vec4f* dst, F32 replaceWeight) const
+{
+	FW_ASSERT(y >= 0 && y < tile.height);
+	int stride = getFrameEncodingStride(m_encoding);
+	const U8* src = m_payload + tile.offset + (size_t)y * tile.width * stride;
+
+	switch (m_encoding)
+	{
+	case FrameEncoding_RGB32F:
+		accumulatePixels(dst, src, tile.width, stride, tile.weight, replaceWeight, [](const U8* p, F32* rgb) { memcpy(rgb, p, 12); });
+		break;
+
+	case FrameEncoding_RGB16F:
+		accumulatePixels(dst, src, tile.width, stride, tile.weight, replaceWeight, [](const U8* p, F32* rgb) {
+			U16 h[3];
+			memcpy(h, p, 6);
+			rgb[0] = halfToFloat(h[0]);
+			rgb[1] = halfToFloat(h[1]);
+			rgb[2] = halfToFloat(h[2]);
+		});
+		break;
+
+	case FrameEncoding_RGB9E5:
+		accumulatePixels(dst, src, tile.width, stride, tile.weight, replaceWeight, [](const U8* p, F32* rgb) {
+			U32 v;
+			memcpy(&v, p, 4);
+			decodeRGB9E5(v, rgb);
+		});
+		break;
+
+	case FrameEncoding_RGBE:
+		accumulatePixels(dst, src, tile.width, stride, tile.weight, replaceWeight, decodeRGBE);
+		break;
+
+	default:
+		FW_ASSERT(false);
+	}
+}
+
+void FrameDecoder::addTile(int x, int y, int width, int height, F32 weight, size_t offset)
+{
+	FrameTile tile;
+	tile.x = x;
+	tile.y = y;
+	tile.width = width;
+	tile.height = height;
+	tile.weight = weight;
+	tile.offset = offset;
+	m_tiles.push_back(tile);
+}
+
+
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+
+#include "base/Math.hpp"
+
+#include <vector>
+
+
+namespace FW {
+
+
+// Pixel encodings a server can use for the indirect-light strips it sends on the frame socket.
+// The client picks one and tells servers through InitialState / control; every frame carries
+// a FrameHeader so the client decodes whatever actually arrives.
+enum FrameEncoding {
+	FrameEncoding_RGB32F = 0,	// 12 bytes per pixel, the raw pColor layout.
+	FrameEncoding_RGB16F,		// 6 bytes per pixel, IEEE half per channel.
+	FrameEncoding_RGB9E5,		// 4 bytes per pixel, 9-bit mantissas with a shared 5-bit exponent.
+	FrameEncoding_RGBE,			// 4 bytes per pixel, Ward's 8-bit mantissas with a shared 8-bit exponent.
+
+	FrameEncoding_Max
+};
+
+enum FrameFlags {
+	FrameFlag_Deflate			= 1 << 0,	// Payload is additionally zlib compressed.
+	FrameFlag_Delta				= 1 << 1,	// Payload is a list of tiles holding new samples only.
+	FrameFlag_PreviewHalf		= 1 << 2,	// Reduced-resolution preview, see getFramePreviewScale.
+	FrameFlag_PreviewQuarter	= 1 << 3
+};
+
+// Preview frames (WirePreview) hold one value per scale x scale pixels, for the pixels of the
+// strip or tile whose image coordinates are both multiples of scale; width and height count
+// those. The client upsamples them guided by its G-buffer.
+inline int	getFramePreviewScale	(U32 flags)		{ return (flags & FrameFlag_PreviewQuarter) ? 4 : (flags & FrameFlag_PreviewHalf) ? 2 : 1; }
+inline U32	getFramePreviewFlags	(int scale)		{ return scale >= 4 ? FrameFlag_PreviewQuarter : scale >= 2 ? FrameFlag_PreviewHalf : 0; }
+
+// Header in front of every encoded frame. Headers and pixels are copied in the native x86
+// layout (little-endian, no padding) rather than serialized field by field like the wire
+// protocol, so big-endian machines cannot take part. width and height are those of the
+// server's strip, or of the tile for frames answering a TileAssignment.
+struct FrameHeader {
+	enum { Magic = 0x31524650 };	// "PFR1"
+
+	U32		magic;
+	U8		encoding;		// FrameEncoding
+	U8		flags;			// FrameFlags
+	U16		reserved;
+	S32		width;
+	S32		height;
+	U32		payloadSize;	// Bytes following the header.
+	U32		epoch;			// Input epoch (CameraControls::getEpoch) the frame was rendered for.
+	S32		tileId;			// TileScheduler tile the frame covers, -1 for strips.
+};
+
+// Delta payloads are a U32 tile count followed by this header and the tile's pixels for each
+// tile. Pixels hold the mean of the tile's new samples, weight how many samples per pixel
+// that mean stands for.
+struct FrameTileHeader {
+	U16		x, y;
+	U16		width, height;
+	F32		weight;
+};
+
+enum { FrameTileSize = 16 };
+
+
+const char*	getFrameEncodingName	(FrameEncoding encoding);
+int			getFrameEncodingStride	(FrameEncoding encoding);	// Bytes per pixel before compression.
+
+// Encodes width * height RGB triplets (rgb[3 * i + c]) as a full frame, header included.
+void		encodeFrame				(std::vector<U8>& out, const F32* rgb, int width, int height, FrameEncoding encoding, U32 flags, U32 epoch, S32 tileId = -1);
+
+// Reads the header of a frame message without decoding it. Returns false for headerless frames.
+bool		peekFrameHeader			(const void* data, size_t size, FrameHeader& header);
+
+
+// Server side of delta mode. Passes are accumulated per pixel and a tile is only sent once
+// its pending samples would move the client's estimate by more than the threshold, so a
+// converged view stops producing traffic.
+class FrameDeltaEncoder {
+public:
+					FrameDeltaEncoder	(void);
+
+	void			reset				(int width, int height);	// Call on every camera change.
+	void			setThreshold		(F32 relativeChange)	{ m_threshold = relativeChange; }
+
+	// Adds a pass whose per-pixel mean is rgb and which took weight samples per pixel.
+	void			addPass				(const F32* rgb, F32 weight);
+
+	// Encodes all tiles due for sending. Returns false if none are.
+	bool			encode				(std::vector<U8>& out, FrameEncoding encoding, U32 flags, U32 epoch, S32 tileId = -1);
+
+private:
+	int				m_width;
+	int				m_height;
+	int				m_tilesX;
+	F32				m_threshold;
+	std::vector<F32> m_sent;			// Per-pixel radiance sums already sent.
+	std::vector<F32> m_pending;			// Per-pixel radiance sums not yet sent.
+	std::vector<F32> m_sentWeight;		// Per tile.
+	std::vector<F32> m_pendingWeight;	// Per tile.
+};
+
+
+// A decoded rectangle of a strip.
+struct FrameTile {
+	int		x, y;
+	int		width, height;
+	F32		weight;		// Samples per pixel behind the values, 0 for full frames that replace earlier data.
+	size_t	offset;		// Byte offset of the tile's first pixel in the payload.
+};
+
+// Client side. Parses full frames, delta frames and headerless width * height * 12 byte
+// pColor arrays from servers predating the header. Pixels are not decoded up front: they are
+// read straight from the message by accumulateRow, so the message must stay alive and
+// unmoved while its tiles are used. Only deflated payloads are copied, into a reused buffer.
+class FrameDecoder {
+public:
+						FrameDecoder	(void) : m_payload(nullptr), m_encoding(FrameEncoding_RGB32F) {}
+
+	// Returns false if the message does not fit a width x height strip or is malformed.
+	bool				decode			(const void* data, size_t size, int width, int height);
+
+	// Takes the size from the header; headerless frames cannot be decoded without knowing it.
+	bool				decode			(const void* data, size_t size);
+
+	int					getNumTiles		(void) const			{ return (int)m_tiles.size(); }
+	const FrameTile&	getTile			(int i) const			{ return m_tiles[i]; }
+
+	// Decodes row y of a tile into dst[0 .. tile.width). Tiles with weight 0 overwrite dst
+	// with rgb * replaceWeight and w = replaceWeight, the samples per pixel the sender
+	// rendered; others add their rgb * weight and weight to w.
+	void				accumulateRow	(const FrameTile& tile, int y, Vec4f* dst, F32 replaceWeight) const;
+
+private:
+	void				addTile			(int x, int y, int width, int height, F32 weight, size_t offset);
+
+	std::vector<U8>			m_inflated;
+	const U8*				m_payload;
+	FrameEncoding			m_encoding;
+	std::vector<FrameTile>	m_tiles;
+};
+
+
+}
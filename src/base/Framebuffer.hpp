@@ -0,0 +1,91 @@
+#pragma once
+
+
+#include "base/Math.hpp"
+#include "gui/Image.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <type_traits>
+
+
+namespace FW {
+
+
+// Typed, tightly packed 2D pixel buffer used by the renderer passes.
+// Unlike Image, accesses do no format dispatch: rows are plain T arrays, so
+// inner loops can walk a row pointer instead of calling getVec4f/setVec4f.
+//
+// Storage is not written when it is allocated, so each page lands on the
+// NUMA node of the thread that first clears it; see clearRows.
+template <class T>
+class Framebuffer {
+	static_assert(std::is_trivially_copyable<T>::value, "Framebuffer pixels are copied as raw memory");
+
+public:
+	Framebuffer() : m_size(0), m_pixels(NULL), m_capacity(0) {}
+	explicit Framebuffer(const Vec2i& size) : m_size(0), m_pixels(NULL), m_capacity(0) { resize(size); }
+	~Framebuffer() { std::free(m_pixels); }
+
+	// Contents are undefined until cleared or written. Returns true if the storage was
+	// reallocated, which only happens when it grows.
+	bool				resize		(const Vec2i& size) {
+		FW_ASSERT(size.x >= 0 && size.y >= 0);
+		m_size = size;
+		size_t count = (size_t)size.x * size.y;
+		if (count <= m_capacity)
+			return false;
+		std::free(m_pixels);
+		m_pixels = (T*)std::malloc(count * sizeof(T));
+		if (!m_pixels)
+			fail("Framebuffer: out of memory");
+		m_capacity = count;
+		return true;
+	}
+
+	void				clear		(const T& value = T(0))		{ clearRows(0, m_size.y, value); }
+	void				clearRows	(int y0, int y1, const T& value = T(0))	{ FW_ASSERT(y0 >= 0 && y0 <= y1 && y1 <= m_size.y); std::fill(m_pixels + (size_t)y0 * m_size.x, m_pixels + (size_t)y1 * m_size.x, value); }
+
+	const Vec2i&		getSize		(void) const				{ return m_size; }
+	int					getWidth	(void) const				{ return m_size.x; }
+	int					getHeight	(void) const				{ return m_size.y; }
+
+	T*					getRow		(int y)						{ FW_ASSERT(y >= 0 && y < m_size.y); return &m_pixels[(size_t)y * m_size.x]; }
+	const T*			getRow		(int y) const				{ FW_ASSERT(y >= 0 && y < m_size.y); return &m_pixels[(size_t)y * m_size.x]; }
+	T*					getPtr		(void)						{ return m_pixels; }
+	const T*			getPtr		(void) const				{ return m_pixels; }
+
+	T&					operator()	(int x, int y)				{ return m_pixels[(size_t)y * m_size.x + x]; }
+	const T&			operator()	(int x, int y) const		{ return m_pixels[(size_t)y * m_size.x + x]; }
+
+private:
+						Framebuffer	(const Framebuffer&); // forbidden
+	Framebuffer&		operator=	(const Framebuffer&); // forbidden
+
+	Vec2i				m_size;
+	T*					m_pixels;
+	size_t				m_capacity;
+};
+
+
+// Row view of an RGBA_Vec4f Image, e.g. the display image handed to GLContext::drawImage.
+// The format is checked and the buffer is mapped to the CPU once, up front, so the
+// view can be shared by the threads of a parallel pass.
+class Vec4fImageRows {
+public:
+	explicit Vec4fImageRows(Image& image)
+		: m_base(image.getMutablePtr()),
+		  m_stride(image.getStride())
+	{
+		FW_ASSERT(image.getFormat().getID() == ImageFormat::RGBA_Vec4f);
+	}
+
+	Vec4f*				getRow		(int y) const				{ return (Vec4f*)(m_base + y * m_stride); }
+
+private:
+	U8*					m_base;
+	S64					m_stride;
+};
+
+
+}
@@ -0,0 +1,141 @@
+#include "HeartbeatMonitor.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace FW {
+
+
+static const F64	s_pingInterval	= 0.1;	// Seconds between pings to each server.
+static const F64	s_minTimeout	= 0.3;	// Bounds of the silence tolerated from a server that answers pings.
+static const F64	s_maxTimeout	= 0.9;
+static const F64	s_joinTimeout	= 5.0;	// For servers that have not answered yet.
+static const F64	s_rttGain		= 0.125;
+static const F64	s_jitterGain	= 0.25;
+
+
+HeartbeatMonitor::HeartbeatMonitor(void)
+:	m_lastService	(Clock::now())
+{
+}
+
+void HeartbeatMonitor::service(Clock::time_point now)
+{
+	// Messages that arrived during a stall are only read now, so nobody could be heard.
+	bool stalled = std::chrono::duration<F64>(now - m_lastService).count() > s_maxTimeout;
+	m_lastService = now;
+	if (!stalled)
+		return;
+
+	for (auto& it : m_servers)
+	{
+		it.second.stats.lastHeard = now;
+		it.second.measureSince = now;
+	}
+}
+
+void HeartbeatMonitor::addServer(const std::string& server, Clock::time_point now)
+{
+	Server& s = m_servers[server];
+	s = Server();
+	s.answered = false;
+	s.sequence = 0;
+	s.stats.lastHeard = now;
+	s.lastPing = now;
+	s.measureSince = now;
+}
+
+void HeartbeatMonitor::removeServer(const std::string& server)
+{
+	m_servers.erase(server);
+}
+
+void HeartbeatMonitor::recordTraffic(const std::string& server, Clock::time_point now)
+{
+	auto it = m_servers.find(server);
+	if (it != m_servers.end())
+		it->second.stats.lastHeard = now;
+}
+
+void HeartbeatMonitor::recordEcho(const std::string& server, U32 sequence, Clock::time_point now)
+{
+	auto it = m_servers.find(server);
+	if (it == m_servers.end())
+		return;
+
+	Server& s = it->second;
+	s.stats.lastHeard = now;
+	if (sequence == 0 || s.sequence - sequence >= NumSentTimes || s.sent[sequence % NumSentTimes] < s.measureSince)
+		return;
+
+	F64 rtt = std::chrono::duration<F64>(now - s.sent[sequence % NumSentTimes]).count();
+	ServerStats& st = s.stats;
+	if (!s.answered)
+	{
+		st.rtt = rtt;
+		st.jitter = rtt * 0.5;
+		s.answered = true;
+	}
+	else
+	{
+		st.jitter += (std::abs(rtt - st.rtt) - st.jitter) * s_jitterGain;
+		st.rtt += (rtt - st.rtt) * s_rttGain;
+	}
+}
+
+void HeartbeatMonitor::collectPings(Clock::time_point now, std::vector<std::pair<std::string, U32> >& pings)
+{
+	for (auto& it : m_servers)
+	{
+		Server& s = it.second;
+		if (std::chrono::duration<F64>(now - s.lastPing).count() < s_pingInterval)
+			continue;
+
+		// Sequence 0 is never sent, so an echo of it matches nothing.
+		if (++s.sequence == 0)
+			++s.sequence;
+		s.sent[s.sequence % NumSentTimes] = now;
+		s.lastPing = now;
+		pings.push_back(std::make_pair(it.first, s.sequence));
+	}
+}
+
+void HeartbeatMonitor::collectDead(Clock::time_point now, std::vector<std::string>& dead)
+{
+	for (auto it = m_servers.begin(); it != m_servers.end();)
+	{
+		if (std::chrono::duration<F64>(now - it->second.stats.lastHeard).count() > getTimeout(it->second))
+		{
+			dead.push_back(it->first);
+			it = m_servers.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+const HeartbeatMonitor::ServerStats* HeartbeatMonitor::getStats(const std::string& server) const
+{
+	auto it = m_servers.find(server);
+	return (it == m_servers.end()) ? nullptr : &it->second.stats;
+}
+
+F64 HeartbeatMonitor::getTimeout(const std::string& server) const
+{
+	auto it = m_servers.find(server);
+	return (it == m_servers.end()) ? 0.0 : getTimeout(it->second);
+}
+
+F64 HeartbeatMonitor::getTimeout(const Server& s) const
+{
+	if (!s.answered)
+		return s_joinTimeout;
+
+	// The ping interval is added since silence is measured from the last message heard,
+	// which may precede the next ping by up to one interval.
+	F64 timeout = s.stats.rtt + 4.0 * s.stats.jitter + s_pingInterval;
+	return std::min(std::max(timeout, s_minTimeout), s_maxTimeout);
+}
+
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+
+#include "base/Defs.hpp"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace FW {
+
+
+// Detects render servers that stopped responding. Every server is pinged at a short interval
+// and echoes the ping back, which measures its round trip time. A server that stays silent
+// for longer than its smoothed RTT plus four times the RTT deviation (the TCP retransmission
+// timeout rule) is declared dead, within a fraction of a second on a healthy network.
+//
+// Any control message or frame from a server counts as a sign of life. Until a server has
+// echoed its first ping, e.g. while it loads the scene, it gets a longer grace period.
+// Silence only counts while the caller keeps servicing the monitor: after a stall of the
+// caller's own loop, e.g. while loading a mesh, every server starts over.
+class HeartbeatMonitor {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct ServerStats {
+		F64		rtt;			// Smoothed round trip time in seconds, 0 until measured.
+		F64		jitter;			// Smoothed mean deviation of the round trip time.
+		Clock::time_point lastHeard;
+
+		ServerStats() : rtt(0.0), jitter(0.0) {}
+	};
+
+						HeartbeatMonitor	(void);
+
+	// Call first thing in every iteration of the loop that reads the servers' messages.
+	void				service				(Clock::time_point now);
+
+	void				addServer			(const std::string& server, Clock::time_point now);
+	void				removeServer		(const std::string& server);
+
+	void				recordTraffic		(const std::string& server, Clock::time_point now);
+	void				recordEcho			(const std::string& server, U32 sequence, Clock::time_point now);
+
+	// Servers due for a ping, with the sequence number to send; the pings count as sent.
+	void				collectPings		(Clock::time_point now, std::vector<std::pair<std::string, U32> >& pings);
+
+	// Removes and returns the servers that have been silent for longer than their timeout.
+	void				collectDead			(Clock::time_point now, std::vector<std::string>& dead);
+
+	const ServerStats*	getStats			(const std::string& server) const;
+	F64					getTimeout			(const std::string& server) const;
+
+private:
+	enum { NumSentTimes = 16 };	// Pings older than this many are not matched to their echo.
+
+	struct Server {
+		ServerStats			stats;
+		bool				answered;	// An echo has been received.
+		U32					sequence;	// Of the last ping sent.
+		Clock::time_point	lastPing;
+		Clock::time_point	sent[NumSentTimes];
+		Clock::time_point	measureSince;	// Echoes of earlier pings would include a stall.
+	};
+
+	F64					getTimeout			(const Server& s) const;
+
+	std::map<std::string, Server> m_servers;
+	Clock::time_point	m_lastService;
+};
+
+
+}
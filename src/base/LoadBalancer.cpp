@@ -0,0 +1,141 @@
+#include "LoadBalancer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace FW {
+
+
+static const F64	s_smoothing		= 0.25;	// Weight of a new measurement in the moving averages.
+static const int	s_minRows		= 8;	// Smallest strip handed to any server.
+
+
+LoadBalancer::LoadBalancer(void)
+:	m_epochStart(Clock::now())
+{
+}
+
+void LoadBalancer::startEpoch(void)
+{
+	m_epochStart = Clock::now();
+	for (auto& it : m_stats)
+		it.second.seenThisEpoch = false;
+}
+
+void LoadBalancer::recordFrame(const std::string& server, F64 samples)
+{
+	Clock::time_point now = Clock::now();
+	ServerStats& s = m_stats[server];
+
+	if (!s.seenThisEpoch)
+	{
+		// The first frame after a change measures latency. Its samples were produced
+		// over an unknown span, so it does not count towards throughput.
+		F64 latency = std::chrono::duration<F64>(now - m_epochStart).count();
+		s.latency = (s.latency == 0.0) ? latency : s.latency + (latency - s.latency) * s_smoothing;
+		s.seenThisEpoch = true;
+	}
+	else
+	{
+		F64 dt = std::chrono::duration<F64>(now - s.lastFrame).count();
+		if (dt > 0.0)
+		{
+			F64 rate = samples / dt;
+			s.samplesPerSecond = (s.samplesPerSecond == 0.0) ? rate : s.samplesPerSecond + (rate - s.samplesPerSecond) * s_smoothing;
+		}
+	}
+	s.lastFrame = now;
+}
+
+void LoadBalancer::removeServer(const std::string& server)
+{
+	m_stats.erase(server);
+}
+
+const LoadBalancer::ServerStats* LoadBalancer::getStats(const std::string& server) const
+{
+	auto it = m_stats.find(server);
+	return (it == m_stats.end()) ? nullptr : &it->second;
+}
+
+void LoadBalancer::computeLayout(std::vector<Strip>& layout, const std::vector<std::string>& servers, int imageWidth, int imageHeight, int samplesPerPixel) const
+{
+	int n = (int)servers.size();
+	layout.resize(n);
+	if (n == 0)
+		return;
+
+	// Rates and latencies, with unmeasured servers at the average of the measured ones.
+	std::vector<F64> rate(n, 0.0), latency(n, 0.0);
+	F64 rateSum = 0.0, latencySum = 0.0;
+	int measured = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		const ServerStats* s = getStats(servers[i]);
+		if (s && s->samplesPerSecond > 0.0)
+		{
+			rate[i] = s->samplesPerSecond;
+			latency[i] = s->latency;
+			rateSum += rate[i];
+			latencySum += latency[i];
+			++measured;
+		}
+	}
+	for (int i = 0; i < n; ++i)
+	{
+		if (rate[i] == 0.0)
+		{
+			rate[i] = measured ? rateSum / measured : 1.0;
+			latency[i] = measured ? latencySum / measured : 0.0;
+		}
+	}
+
+	// A strip of h rows takes latency + h * rowCost / rate. Equalizing that time T across
+	// servers with sum(h) = imageHeight gives h_i = (T - latency_i) * rate_i / rowCost.
+	F64 rowCost = (F64)std::max(imageWidth, 1) * std::max(samplesPerPixel, 1);
+	F64 totalRate = 0.0, weightedLatency = 0.0;
+	for (int i = 0; i < n; ++i)
+	{
+		totalRate += rate[i];
+		weightedLatency += latency[i] * rate[i];
+	}
+	F64 T = (imageHeight * rowCost + weightedLatency) / totalRate;
+
+	std::vector<F64> rows(n);
+	F64 rowSum = 0.0;
+	for (int i = 0; i < n; ++i)
+	{
+		rows[i] = std::max((T - latency[i]) * rate[i] / rowCost, (F64)s_minRows);
+		rowSum += rows[i];
+	}
+
+	// Round to whole rows, keeping the running total exact so the strips tile the image.
+	int minRows = std::min(s_minRows, imageHeight / n);
+	F64 scale = imageHeight / rowSum;
+	F64 accum = 0.0;
+	int vStart = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		accum += rows[i] * scale;
+		int vEnd = (i == n - 1) ? imageHeight : (int)floor(accum + 0.5);
+		vEnd = std::max(vEnd, vStart + minRows);
+		vEnd = std::min(vEnd, imageHeight - (n - 1 - i) * minRows);
+		layout[i].vStart = vStart;
+		layout[i].vHeight = vEnd - vStart;
+		vStart = vEnd;
+	}
+}
+
+bool LoadBalancer::differs(const std::vector<Strip>& a, const std::vector<Strip>& b, int imageHeight, F32 fraction)
+{
+	if (a.size() != b.size())
+		return true;
+	int tolerance = (int)(imageHeight * fraction);
+	for (size_t i = 0; i < a.size(); ++i)
+		if (std::abs(a[i].vStart - b[i].vStart) > tolerance || std::abs(a[i].vHeight - b[i].vHeight) > tolerance)
+			return true;
+	return false;
+}
+
+
+}
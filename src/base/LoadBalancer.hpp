@@ -0,0 +1,59 @@
+#pragma once
+
+
+#include "base/Defs.hpp"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace FW {
+
+
+// Splits the image into one horizontal strip per server, sized from each server's measured
+// throughput and response latency so that all strips are expected to finish together.
+// Servers are identified by their ROUTER identity; strips are indexed by block id.
+class LoadBalancer {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Strip {
+		int		vStart;
+		int		vHeight;
+	};
+
+	struct ServerStats {
+		F64		samplesPerSecond;	// Smoothed pixel samples per second, 0 until measured.
+		F64		latency;			// Smoothed seconds from an epoch start to the server's first frame.
+		bool	seenThisEpoch;
+		Clock::time_point lastFrame;
+
+		ServerStats() : samplesPerSecond(0.0), latency(0.0), seenThisEpoch(false) {}
+	};
+
+						LoadBalancer		(void);
+
+	// Marks the start of new work for every server, e.g. a camera move or reassignment.
+	void				startEpoch			(void);
+
+	// Accounts a received frame that carried the given number of pixel samples.
+	void				recordFrame			(const std::string& server, F64 samples);
+	void				removeServer		(const std::string& server);
+	const ServerStats*	getStats			(const std::string& server) const;
+	Clock::time_point	getEpochStart		(void) const				{ return m_epochStart; }
+
+	// Strip layout for servers listed in block id order. Unmeasured servers count as average.
+	void				computeLayout		(std::vector<Strip>& layout, const std::vector<std::string>& servers, int imageWidth, int imageHeight, int samplesPerPixel) const;
+
+	// True if any strip boundary moved by more than fraction * imageHeight rows.
+	static bool			differs				(const std::vector<Strip>& a, const std::vector<Strip>& b, int imageHeight, F32 fraction);
+
+private:
+	std::map<std::string, ServerStats> m_stats;
+	Clock::time_point	m_epochStart;
+};
+
+
+}
@@ -0,0 +1,430 @@
+#include "LoopbackServer.hpp"
+#include "Foveation.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace FW {
+
+
+static const char*	s_inputPort		= ":5555";
+static const char*	s_controlPort	= ":5556";
+static const char*	s_framePort		= ":5557";
+static const F64	s_tileRetry		= 0.005;	// Seconds before asking again when every tile is taken.
+
+
+LoopbackServer::LoopbackServer(const std::string& name, const LoopbackConfig& config)
+:	m_name			(name),
+	m_config		(config),
+	m_quit			(false),
+	m_framesSent	(0),
+	m_bytesSent		(0),
+	m_epoch			(0),
+	m_size			(0),
+	m_credits		(0),
+	m_random		((U32)std::hash<std::string>()(name))
+{
+	// Value-initialized, which zeroes the plain fields next to the vectors.
+	m_camera = WireCameraState();
+	m_settings = WireRenderSettings();
+	m_foveation = WireFoveation();
+	m_preview.scale = 1;
+	m_strip = WireStripAssignment();
+	m_tile = WireTileAssignment();
+	m_tile.tileId = -1;
+}
+
+LoopbackServer::~LoopbackServer(void)
+{
+	stop();
+}
+
+void LoopbackServer::start(void)
+{
+	FW_ASSERT(!m_thread.joinable());
+	m_quit = false;
+	m_thread = std::thread(&LoopbackServer::run, this);
+}
+
+void LoopbackServer::stop(void)
+{
+	if (!m_thread.joinable())
+		return;
+	m_quit = true;
+	m_thread.join();
+}
+
+//------------------------------------------------------------------------
+
+void LoopbackServer::run(void)
+{
+	std::string host = "tcp://" + m_config.host;
+	zmq::context_t context(1);
+
+	zmq::socket_t input(context, zmq::socket_type::sub);
+	input.set(zmq::sockopt::subscribe, "");
+	input.set(zmq::sockopt::linger, 0);
+	input.connect(host + s_inputPort);
+
+	// The client tells servers apart by identity, on both sockets.
+	zmq::socket_t control(context, zmq::socket_type::dealer);
+	control.set(zmq::sockopt::routing_id, m_name);
+	control.set(zmq::sockopt::linger, 0);
+	control.connect(host + s_controlPort);
+
+	zmq::socket_t frames(context, zmq::socket_type::dealer);
+	frames.set(zmq::sockopt::routing_id, m_name);
+	frames.set(zmq::sockopt::linger, 0);
+	frames.connect(host + s_framePort);
+
+	zmq::pollitem_t items[] = {
+		{ input.handle(), 0, ZMQ_POLLIN, 0 },
+		{ control.handle(), 0, ZMQ_POLLIN, 0 }
+	};
+
+	join(control);
+	Clock::time_point silentUntil = Clock::now();
+	bool silent = false;
+
+	while (!m_quit.load(std::memory_order_relaxed))
+	{
+		zmq::poll(items, 2, std::chrono::milliseconds(1));
+		Clock::time_point now = Clock::now();
+
+		// A failed server neither answers nor sends; what arrives meanwhile is lost.
+		zmq::message_t message;
+		while (input.recv(message, zmq::recv_flags::dontwait).has_value())
+			if (!silent)
+				handleFrame(message, control);
+		while (control.recv(message, zmq::recv_flags::dontwait).has_value())
+			if (!silent)
+				handleFrame(message, control);
+
+		if (silent)
+		{
+			if (m_config.failFor > 0.0 && now >= silentUntil)
+			{
+				silent = false;
+				join(control);
+			}
+			continue;
+		}
+
+		if (m_config.failAfter > 0.0 && std::chrono::duration<F64>(now - m_joined).count() >= m_config.failAfter)
+		{
+			silent = true;
+			silentUntil = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<F64>(m_config.failFor));
+			m_pending.clear();
+			continue;
+		}
+
+		renderPass(control);
+
+		while (!m_pending.empty() && m_pending.front().due <= now)
+		{
+			std::vector<U8>& data = m_pending.front().data;
+			frames.send(zmq::buffer(data), zmq::send_flags::none);
+			m_framesSent.fetch_add(1, std::memory_order_relaxed);
+			m_bytesSent.fetch_add(data.size(), std::memory_order_relaxed);
+			m_pending.pop_front();
+		}
+	}
+}
+
+void LoopbackServer::join(zmq::socket_t& control)
+{
+	// Any message from an unknown identity is a join; the reply carries the full state.
+	m_camera.sequence = 0;
+	m_strip.vHeight = 0;
+	m_tile.tileId = -1;
+	m_joined = Clock::now();
+
+	WireWriter hello;
+	WireHeartbeat heartbeat = { 0 };
+	writeWire(hello, heartbeat);
+	const Array<U8>& data = hello.finish(m_epoch);
+	control.send(zmq::buffer(data.getPtr(), data.getSize()), zmq::send_flags::none);
+}
+
+void LoopbackServer::handleFrame(const zmq::message_t& message, zmq::socket_t& control)
+{
+	WireReader r;
+	if (!r.reset(message.data(), (int)message.size()))
+		return;
+
+	// Epochs only grow; a frame may still arrive late on the other socket.
+	bool restart = (S32)(r.getEpoch() - m_epoch) > 0;
+	if (restart)
+		m_epoch = r.getEpoch();
+
+	while (r.nextMessage())
+	{
+		switch (r.getType())
+		{
+		case WireMessage_CameraState:
+			{
+				WireCameraState camera;
+				if (readWire(r, camera) && (camera.sequence == 0 || camera.sequence > m_camera.sequence))
+					m_camera = camera;
+			}
+			break;
+
+		case WireMessage_RenderSettings:
+			readWire(r, m_settings);
+			restart = true;
+			break;
+
+		case WireMessage_Foveation:
+			readWire(r, m_foveation);
+			restart = true;
+			break;
+
+		case WireMessage_Preview:
+			readWire(r, m_preview);
+			restart = true;
+			break;
+
+		case WireMessage_Resize:
+			{
+				WireResize resize;
+				if (readWire(r, resize))
+					m_size = Vec2i(resize.size);
+			}
+			break;
+
+		case WireMessage_StripAssignment:
+			readWire(r, m_strip);
+			restart = true;
+			break;
+
+		case WireMessage_TileAssignment:
+			{
+				WireTileAssignment tile;
+				if (!readWire(r, tile))
+					break;
+				if (tile.tileId >= 0)
+				{
+					m_tile = tile;
+					m_workStart = Clock::now();
+				}
+				else
+					m_nextTileRequest = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<F64>(s_tileRetry));
+			}
+			break;
+
+		case WireMessage_Heartbeat:
+			{
+				WireHeartbeat ping;
+				if (readWire(r, ping) && ping.sequence != 0)
+				{
+					WireWriter echo;
+					writeWire(echo, ping);
+					const Array<U8>& data = echo.finish(m_epoch);
+					control.send(zmq::buffer(data.getPtr(), data.getSize()), zmq::send_flags::none);
+				}
+			}
+			break;
+
+		case WireMessage_FrameCredit:
+			{
+				WireFrameCredit credit;
+				if (readWire(r, credit) && r.getEpoch() == m_epoch)
+				{
+					m_credits = min(m_credits + (S32)credit.credits, (S32)m_settings.framesInFlight);
+					m_lastCredit = Clock::now();
+				}
+			}
+			break;
+
+		case WireMessage_Shutdown:
+			m_settings.rtMode = false;
+			break;
+
+		default:
+			// Scene loading and asset transfers are not simulated.
+			break;
+		}
+	}
+
+	if (restart)
+		restartWork();
+}
+
+void LoopbackServer::restartWork(void)
+{
+	m_workStart = Clock::now();
+	m_pending.clear();
+	m_tile.tileId = -1;
+	m_nextTileRequest = Clock::time_point();
+	m_credits = m_settings.framesInFlight;
+	m_lastCredit = m_workStart;
+	int scale = max((int)m_preview.scale, 1);
+	int rows = (m_strip.vStart + m_strip.vHeight + scale - 1) / scale - (m_strip.vStart + scale - 1) / scale;
+	m_delta.reset(max((m_size.x + scale - 1) / scale, 1), max(rows, 1));
+}
+
+void LoopbackServer::renderPass(zmq::socket_t& control)
+{
+	if (!m_settings.rtMode || m_size.x <= 0 || m_size.y <= 0)
+		return;
+
+	Clock::time_point now = Clock::now();
+	int x0, y0, width, height;
+	S32 tileId = -1;
+
+	// Out of credits: stall until the client catches up, but not forever in case a grant was lost.
+	if (m_settings.framesInFlight && m_credits <= 0)
+	{
+		if (now - m_lastCredit < std::chrono::seconds(1))
+		{
+			m_workStart = now;
+			return;
+		}
+		m_credits = 1;
+		m_lastCredit = now;
+	}
+
+	if (m_settings.pullTiles)
+	{
+		if (m_tile.tileId < 0)
+		{
+			if (now < m_nextTileRequest)
+				return;
+
+			// Not answered yet; asks again after a while in case the request was lost.
+			WireWriter request;
+			writeWire(request, WireMessage_TileRequest);
+			const Array<U8>& data = request.finish(m_epoch);
+			control.send(zmq::buffer(data.getPtr(), data.getSize()), zmq::send_flags::none);
+			m_nextTileRequest = now + std::chrono::milliseconds(100);
+			m_workStart = now;
+			return;
+		}
+		x0 = m_tile.x;
+		y0 = m_tile.y;
+		width = m_tile.width;
+		height = m_tile.height;
+		tileId = m_tile.tileId;
+	}
+	else
+	{
+		x0 = 0;
+		y0 = m_strip.vStart;
+		width = m_size.x;
+		height = min(m_strip.vHeight, m_size.y - m_strip.vStart);
+		if (height <= 0)
+			return;
+	}
+
+	// The pass is done once the configured throughput would have produced its samples.
+	// Previews shade the pixels whose coordinates are multiples of the scale.
+	int scale = max((int)m_preview.scale, 1);
+	int firstRow = (y0 + scale - 1) / scale;
+	width = (width + scale - 1) / scale;
+	height = (y0 + height + scale - 1) / scale - firstRow;
+	y0 = firstRow * scale;
+
+	int spp = getFoveatedSamples(m_foveation, max(m_settings.spp, 1), getFoveaPriority(m_foveation, m_size, x0, y0, width * scale, height * scale));
+	F64 seconds = (F64)width * height * spp / m_config.throughput;
+	if (std::chrono::duration<F64>(now - m_workStart).count() < seconds)
+		return;
+	m_workStart = now;
+
+	std::vector<F32> rgb;
+	synthesize(rgb, x0, y0, width, height);
+
+	PendingFrame frame;
+	FrameEncoding encoding = (FrameEncoding)min((int)m_settings.frameEncoding, (int)FrameEncoding_Max - 1);
+	U32 flags = m_settings.frameFlags | getFramePreviewFlags(scale);
+	if (tileId < 0 && (flags & FrameFlag_Delta))
+	{
+		m_delta.addPass(rgb.data(), (F32)spp);
+		if (!m_delta.encode(frame.data, encoding, flags, m_epoch))
+			return;
+	}
+	else
+		encodeFrame(frame.data, rgb.data(), width, height, encoding, flags & ~FrameFlag_Delta, m_epoch, tileId);
+
+	if (tileId >= 0)
+	{
+		m_tile.tileId = -1;
+		m_nextTileRequest = Clock::time_point();
+	}
+
+	// Frames leave in order, as they would over one TCP connection.
+	F64 delay = max(m_config.latency + m_config.jitter * m_random.getF32Normal(), 0.0);
+	frame.due = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<F64>(delay));
+	if (!m_pending.empty())
+		frame.due = std::max(frame.due, m_pending.back().due);
+	m_pending.push_back(std::move(frame));
+	m_credits--;
+}
+
+void LoopbackServer::synthesize(std::vector<F32>& rgb, int x0, int y0, int width, int height)
+{
+	// Smooth bands that move with the camera, plus some per-pass noise so that progressive
+	// and delta modes have something to converge.
+	rgb.resize(width * height * 3);
+	Vec3f p = m_camera.position + m_camera.forward * 2.0f;
+	for (int y = 0; y < height; ++y)
+	for (int x = 0; x < width; ++x)
+	{
+		F32 u = (F32)(x0 + x) / m_size.x;
+		F32 v = (F32)(y0 + y) / m_size.y;
+		F32 s = 0.5f + 0.5f * sin(6.0f * u + p.x + p.z) * cos(6.0f * v + p.y);
+		F32 noise = 0.02f * (m_random.getF32() - 0.5f);
+		F32* c = &rgb[(y * width + x) * 3];
+		c[0] = 0.06f + 0.10f * s + noise;
+		c[1] = 0.05f + 0.08f * s + noise;
+		c[2] = 0.04f + 0.06f * s + noise;
+	}
+}
+
+//------------------------------------------------------------------------
+
+// Malformed numbers leave the value as it was; the client must not die of a typo.
+static void parseNumber(const std::string& text, int& value)
+{
+	char* end;
+	long v = ::strtol(text.c_str(), &end, 10);
+	if (end != text.c_str() && *end == '\0')
+		value = (int)v;
+}
+
+static void parseNumber(const std::string& text, F64 scale, F64& value)
+{
+	char* end;
+	F64 v = ::strtod(text.c_str(), &end);
+	if (end != text.c_str() && *end == '\0')
+		value = v * scale;
+}
+
+int LoopbackServer::parseArgs(const std::vector<std::string>& args, LoopbackConfig& config)
+{
+	int count = 0;
+	for (size_t i = 0; i + 1 < args.size(); ++i)
+	{
+		const std::string& name = args[i];
+		const std::string& value = args[i + 1];
+		if (name == "-loopback")
+			parseNumber(value, count);
+		else if (name == "-loopback_throughput")
+			parseNumber(value, 1.0e6, config.throughput);
+		else if (name == "-loopback_latency")
+			parseNumber(value, 1.0e-3, config.latency);
+		else if (name == "-loopback_jitter")
+			parseNumber(value, 1.0e-3, config.jitter);
+		else if (name == "-loopback_host")
+			config.host = value;
+		else if (name == "-loopback_fail")
+			::sscanf(value.c_str(), "%lf,%lf", &config.failAfter, &config.failFor);
+		else
+			continue;
+		++i;
+	}
+	return max(count, 0);
+}
+
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+
+#include "base/Defs.hpp"
+#include "base/Math.hpp"
+#include "base/Random.hpp"
+#include "io/WireProtocol.hpp"
+#include "FrameCodec.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zmq.hpp>
+
+
+namespace FW {
+
+
+// Behaviour of a simulated render server.
+struct LoopbackConfig {
+	std::string	host;			// Where the client runs.
+	F64			throughput;		// Pixel samples per second.
+	F64			latency;		// Seconds each frame is held back before it is sent.
+	F64			jitter;			// Standard deviation of the extra delay per frame, in seconds.
+	F64			failAfter;		// Seconds of service before going silent, 0 for never.
+	F64			failFor;		// Seconds of silence before joining again, 0 for good.
+
+	LoopbackConfig() : host("localhost"), throughput(20e6), latency(0.002), jitter(0.0), failAfter(0.0), failFor(0.0) {}
+};
+
+
+// Stand-in for a render server machine, for testing and measuring the client's networking
+// without real servers. It speaks the same protocol over the same sockets: SUB on the input
+// socket, DEALERs on the control and frame sockets, heartbeat echoes, strips and pulled
+// tiles. Instead of path tracing it waits as long as the configured throughput takes for the
+// work and replies with a synthetic indirect-light pattern, so renders look plausible and
+// visibly follow the camera.
+//
+// Servers run on their own threads, either inside the client (-loopback N) or in the
+// headless standin console program (src/standin), see parseArgs. Only portable code goes
+// in here, so that the standin also builds on machines without Windows.
+class LoopbackServer {
+public:
+							LoopbackServer		(const std::string& name, const LoopbackConfig& config);
+							~LoopbackServer		(void);
+
+	void					start				(void);
+	void					stop				(void);
+
+	U32						getNumFramesSent	(void) const	{ return m_framesSent.load(std::memory_order_relaxed); }
+	U64						getNumBytesSent		(void) const	{ return m_bytesSent.load(std::memory_order_relaxed); }
+
+	// Reads -loopback N, -loopback_throughput Msamples/s, -loopback_latency ms,
+	// -loopback_jitter ms, -loopback_fail seconds,seconds and -loopback_host name.
+	// Returns the number of servers asked for.
+	static int				parseArgs			(const std::vector<std::string>& args, LoopbackConfig& config);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct PendingFrame {
+		Clock::time_point	due;
+		std::vector<U8>		data;
+	};
+
+	void					run					(void);
+	void					join				(zmq::socket_t& control);
+	void					handleFrame			(const zmq::message_t& message, zmq::socket_t& control);
+	void					restartWork			(void);
+	void					renderPass			(zmq::socket_t& control);
+	void					synthesize			(std::vector<F32>& rgb, int x0, int y0, int width, int height);
+
+							LoopbackServer		(const LoopbackServer&); // forbidden
+	LoopbackServer&			operator=			(const LoopbackServer&); // forbidden
+
+	std::string				m_name;
+	LoopbackConfig			m_config;
+	std::thread				m_thread;
+	std::atomic<bool>		m_quit;
+	std::atomic<U32>		m_framesSent;
+	std::atomic<U64>		m_bytesSent;
+
+	// Protocol state, owned by the thread.
+	U32						m_epoch;
+	WireCameraState			m_camera;
+	WireRenderSettings		m_settings;
+	WireFoveation			m_foveation;
+	WirePreview				m_preview;
+	Vec2i					m_size;
+	WireStripAssignment		m_strip;
+	WireTileAssignment		m_tile;				// tileId -1 when not holding one.
+	Clock::time_point		m_nextTileRequest;	// Set after a request, cleared by the answer.
+	Clock::time_point		m_workStart;
+	Clock::time_point		m_joined;
+	FrameDeltaEncoder		m_delta;
+	std::deque<PendingFrame> m_pending;			// Rendered, waiting out the simulated latency.
+	S32						m_credits;			// Frames that may still be sent this epoch.
+	Clock::time_point		m_lastCredit;
+	Random					m_random;
+};
+
+
+}
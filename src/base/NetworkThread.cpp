@@ -0,0 +1,157 @@
+#include "NetworkThread.hpp"
+
+#include <chrono>
+
+namespace FW {
+
+
+NetworkThread::NetworkThread(void)
+:	m_context		(1),
+	m_quit			(false),
+	m_epoch			(0),
+	m_droppedFrames	(0),
+	m_staleFrames	(0),
+	m_controlIn		(1024),
+	m_controlOut	(1024),
+	m_frames		(256),
+	m_freeFrames	(256)
+{
+}
+
+NetworkThread::~NetworkThread(void)
+{
+	stop();
+}
+
+void NetworkThread::start(const char* controlEndpoint, const char* frameEndpoint)
+{
+	FW_ASSERT(!m_thread.joinable());
+
+	// Bound here so failures surface on the caller; the sockets belong to the thread from now on.
+	m_router = zmq::socket_t(m_context, zmq::socket_type::router);
+	m_router.bind(controlEndpoint);
+	m_frameRouter = zmq::socket_t(m_context, zmq::socket_type::router);
+	m_frameRouter.bind(frameEndpoint);
+
+	m_quit = false;
+	m_thread = std::thread(&NetworkThread::run, this);
+}
+
+void NetworkThread::stop(void)
+{
+	if (!m_thread.joinable())
+		return;
+
+	m_quit = true;
+	m_thread.join();
+	m_router.close();
+	m_frameRouter.close();
+}
+
+//------------------------------------------------------------------------
+
+bool NetworkThread::receiveControl(RouterMessage& message)
+{
+	return m_controlIn.pop(message);
+}
+
+void NetworkThread::send(const std::string& server, zmq::message_t&& payload)
+{
+	RouterMessage message;
+	message.server = server;
+	message.payload = std::move(payload);
+
+	// Control traffic must not be lost; the thread empties the queue at least every millisecond.
+	while (!m_controlOut.push(std::move(message)))
+		std::this_thread::yield();
+}
+
+std::unique_ptr<ReceivedFrame> NetworkThread::receiveFrame(void)
+{
+	std::unique_ptr<ReceivedFrame> frame;
+	m_frames.pop(frame);
+	return frame;
+}
+
+void NetworkThread::recycleFrame(std::unique_ptr<ReceivedFrame>&& frame)
+{
+	// With the free list full the frame is simply released.
+	m_freeFrames.push(std::move(frame));
+}
+
+//------------------------------------------------------------------------
+
+void NetworkThread::run(void)
+{
+	zmq::pollitem_t items[] = {
+		{ m_router.handle(), 0, ZMQ_POLLIN, 0 },
+		{ m_frameRouter.handle(), 0, ZMQ_POLLIN, 0 }
+	};
+
+	while (!m_quit.load(std::memory_order_relaxed))
+	{
+		RouterMessage out;
+		while (m_controlOut.pop(out))
+		{
+			m_router.send(zmq::buffer(out.server), zmq::send_flags::sndmore);
+			m_router.send(out.payload, zmq::send_flags::none);
+		}
+
+		// Short timeout so outgoing messages queued meanwhile are not held back for long.
+		zmq::poll(items, 2, std::chrono::milliseconds(1));
+
+		zmq::message_t identity;
+		while (m_router.recv(identity, zmq::recv_flags::dontwait).has_value())
+		{
+			RouterMessage in;
+			in.server.assign(static_cast<const char*>(identity.data()), identity.size());
+			m_router.recv(in.payload, zmq::recv_flags::none);
+
+			// Joins and heartbeats are rare; wait for the render loop rather than lose one.
+			while (!m_controlIn.push(std::move(in)) && !m_quit.load(std::memory_order_relaxed))
+				std::this_thread::yield();
+		}
+
+		receiveFrames();
+	}
+}
+
+void NetworkThread::receiveFrames(void)
+{
+	zmq::message_t identity;
+	std::unique_ptr<ReceivedFrame>& frame = m_spareFrame;
+	while (m_frameRouter.recv(identity, zmq::recv_flags::dontwait).has_value())
+	{
+		if (!frame && !m_freeFrames.pop(frame))
+			frame.reset(new ReceivedFrame);
+
+		zmq::message_t& message = frame->message;
+		m_frameRouter.recv(message, zmq::recv_flags::none);
+
+		// Stale and malformed frames leave the frame object to the next message. Frames for a
+		// newer epoch than the last one set are kept: the render loop may not have caught up yet.
+		bool hasHeader = peekFrameHeader(message.data(), message.size(), frame->header);
+		if (hasHeader && (S32)(frame->header.epoch - m_epoch.load(std::memory_order_relaxed)) < 0)
+		{
+			m_staleFrames.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+		if (hasHeader && !frame->decoder.decode(message.data(), message.size()))
+			continue;
+		if (!hasHeader)
+			memset(&frame->header, 0, sizeof(FrameHeader));
+
+		frame->server.assign(static_cast<const char*>(identity.data()), identity.size());
+
+		// A full queue means the render loop is behind; dropping keeps latency bounded.
+		if (!m_frames.push(std::move(frame)))
+			m_droppedFrames.fetch_add(1, std::memory_order_relaxed);
+		frame.reset();
+	}
+
+	// A frame object left over by a dropped message waits in m_spareFrame for the next call;
+	// only the render loop may push into m_freeFrames.
+}
+
+
+}
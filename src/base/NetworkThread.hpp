@@ -0,0 +1,88 @@
+#pragma once
+
+
+#include "base/Defs.hpp"
+#include "FrameCodec.hpp"
+#include "SpscQueue.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <zmq.hpp>
+
+
+namespace FW {
+
+
+// One message on the control ROUTER socket, either direction.
+struct RouterMessage {
+	std::string		server;		// ZeroMQ identity of the peer.
+	zmq::message_t	payload;
+};
+
+// A frame as handed to the render loop. The message is received in place and never moved,
+// since the decoder reads pixels straight out of it; recycled frames reuse both.
+struct ReceivedFrame {
+	std::string		server;
+	FrameHeader		header;		// magic is 0 for headerless frames from older servers.
+	zmq::message_t	message;
+	FrameDecoder	decoder;	// Parsed on the network thread, except for headerless frames: the
+								// render loop parses those once it knows the strip size.
+};
+
+
+// Owns the control (join, heartbeat, assignment) and frame ROUTER sockets and services them
+// on its own thread, so incoming frames are drained and parsed as fast as servers send them
+// rather than once per repaint. The render loop talks to it through single-producer
+// single-consumer queues only: ZeroMQ sockets must not be shared between threads.
+//
+// Every public function except start and stop is meant for the render loop thread.
+class NetworkThread {
+public:
+								NetworkThread		(void);
+								~NetworkThread		(void);
+
+	void						start				(const char* controlEndpoint, const char* frameEndpoint);
+	void						stop				(void);
+
+	// Frames rendered for an older epoch are dropped on arrival without being decoded.
+	void						setEpoch			(U32 epoch)		{ m_epoch.store(epoch, std::memory_order_relaxed); }
+
+	bool						receiveControl		(RouterMessage& message);
+	void						send				(const std::string& server, zmq::message_t&& payload);
+
+	// Frames must be handed back with recycleFrame so their buffers get reused.
+	std::unique_ptr<ReceivedFrame> receiveFrame		(void);
+	void						recycleFrame		(std::unique_ptr<ReceivedFrame>&& frame);
+
+	U32							getNumDroppedFrames	(void) const	{ return m_droppedFrames.load(std::memory_order_relaxed); }
+	U32							getNumStaleFrames	(void) const	{ return m_staleFrames.load(std::memory_order_relaxed); }
+
+private:
+	void						run					(void);
+	void						receiveFrames		(void);
+
+								NetworkThread		(const NetworkThread&); // forbidden
+	NetworkThread&				operator=			(const NetworkThread&); // forbidden
+
+	zmq::context_t				m_context;
+	zmq::socket_t				m_router;
+	zmq::socket_t				m_frameRouter;
+
+	std::thread					m_thread;
+	std::atomic<bool>			m_quit;
+	std::atomic<U32>			m_epoch;
+	std::atomic<U32>			m_droppedFrames;	// Because the render loop fell behind.
+	std::atomic<U32>			m_staleFrames;		// Rendered for an earlier epoch.
+
+	SpscQueue<RouterMessage>	m_controlIn;		// Network thread -> render loop.
+	SpscQueue<RouterMessage>	m_controlOut;		// Render loop -> network thread.
+	SpscQueue<std::unique_ptr<ReceivedFrame> > m_frames;		// Network thread -> render loop.
+	SpscQueue<std::unique_ptr<ReceivedFrame> > m_freeFrames;	// Render loop -> network thread.
+	std::unique_ptr<ReceivedFrame> m_spareFrame;		// Network thread only.
+};
+
+
+}
@@ -1,6 +1,10 @@
 #include "PathTraceRenderer.hpp"
 #include "RayTracer.hpp"
 #include "AreaLight.hpp"
+#include "ColorTransform.hpp"
+#include "TextureCache.hpp"
+#include "ShadingFrames.hpp"
+#include "Brdf.hpp"
 
 #include <atomic>
 #include <chrono>
@@ -14,11 +18,16 @@ namespace FW {
     int PathTraceRenderer::m_kernel = 8;
     int PathTraceRenderer::m_spp = 8;
 	bool PathTraceRenderer::debugVis = false;
-    float PathTraceRenderer::m_revPI = (1 / FW_PI);
+
+    static const int   s_maxBackfillPasses     = 256;      // Samples per pixel a backfilled region can reach.
+    static const float s_bounceRayLength       = 1000.0f;  // Segment length of rays leaving a surface.
+    static const int   s_blockSize             = 32;       // Pixels per side of a render block.
+    const TextureCache* PathTraceRenderer::m_textureCache = nullptr;
+    const ShadingFrames* PathTraceRenderer::m_shadingFrames = nullptr;
 
 	void PathTraceRenderer::getTextureParameters(const RaycastResult& hit, Vec3f& diffuse, Vec3f& n, Vec3f& specular)
 	{
-		MeshBase::Material* mat = hit.tri->m_material;
+		const TextureCache::MaterialTextures& textures = m_textureCache->getMaterial(hit.tri);
 		// YOUR CODE HERE (R1)
 		// Read value from albedo texture into diffuse.
 	    // If textured, use the texture; if not, use Material.diffuse.
@@ -29,16 +38,20 @@ namespace FW {
 
         Vec2f uv = (1 - hit.u - hit.v) * uv0 + hit.u * uv1 + hit.v * uv2;
 
-        Texture& diffuseTex = mat->textures[MeshBase::TextureType_Diffuse];
-        if (diffuseTex.exists())
+        // Texture footprint from the ray differentials: the world-space pixel footprint
+        // mapped to uv space by the triangle's uv-to-world area ratio. Zero selects mip 0.
+        float uvFootprint = 0.0f;
+        float worldArea = hit.tri->area();
+        if (worldArea > 0.0f)
         {
-            const Image& img = *diffuseTex.getImage();
-            Vec2i texelCoords = getTexelCoords(uv, img.getSize());
-            diffuse = img.getVec4f(texelCoords).getXYZ();
+            float footprint = FW::max(hit.dPdx.length(), hit.dPdy.length());
+            float uvArea = FW::abs((uv1 - uv0).cross(uv2 - uv0)) * 0.5f;
+            uvFootprint = footprint * footprint * uvArea / worldArea;
+        }
 
-            diffuse.x = powf(diffuse.x, 2.2f);
-            diffuse.y = powf(diffuse.y, 2.2f);
-            diffuse.z = powf(diffuse.z, 2.2f);
+        if (textures.diffuse)
+        {
+            diffuse = textures.diffuse->sample(uv, textures.diffuse->getLod(uvFootprint)).getXYZ();
         }
         else {
             diffuse = hit.tri->m_material->diffuse.getXYZ();
@@ -50,38 +63,19 @@ namespace FW {
 
         n = ((1 - hit.u - hit.v) * n0 + hit.u * n1 + hit.v * n2).normalized();
 
-        Texture& normalTex = mat->textures[MeshBase::TextureType_Normal];
-        if (normalTex.exists() && m_normalMapped)
+        if (textures.normal && m_normalMapped)
         {
-            const Image& img = *normalTex.getImage();
-            Vec2i texelCoords = getTexelCoords(uv, img.getSize());
-            Vec3f norm = (img.getVec4f(texelCoords).getXYZ() * 2.0f - 1.0f).normalized();
-
-            Vec3f deltaPos1 = hit.tri->m_vertices[1].p - hit.tri->m_vertices[0].p;
-            Vec3f deltaPos2 = hit.tri->m_vertices[2].p - hit.tri->m_vertices[0].p;
-
-            Vec2f deltaUV1 = uv1 - uv0;
-            Vec2f deltaUV2 = uv2 - uv0;
-
-            float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
-            Vec3f t = ((deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r).normalized();
-            Vec3f b = ((deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r).normalized();
-
-            Mat3f tbn;
-
-            tbn.col(0) = t;
-            tbn.col(1) = b;
-            tbn.col(2) = n;
-
-            n = (tbn * norm).normalized();
+            const ShadingFrames::Frame& frame = m_shadingFrames->getFrame(hit.tri);
+            if (frame.tangent != Vec3f(0.0f))
+            {
+                Vec3f norm = (textures.normal->sample(uv, textures.normal->getLod(uvFootprint)).getXYZ() * 2.0f - 1.0f).normalized();
+                n = ShadingFrames::toWorld(frame, n, norm);
+            }
         }
 
-        Texture& specularTex = mat->textures[MeshBase::TextureType_Specular];
-        if (specularTex.exists())
+        if (textures.specular)
         {
-            const Image& img = *specularTex.getImage();
-            Vec2i texelCoords = getTexelCoords(uv, img.getSize());
-            specular = img.getVec4f(texelCoords).getXYZ();
+            specular = textures.specular->sample(uv, textures.specular->getLod(uvFootprint)).getXYZ();
         }
         else
         {
@@ -98,6 +92,7 @@ PathTracerContext::PathTracerContext()
       m_light(nullptr),
       m_pass(0),
       m_bounces(0),
+      m_previewScale(1),
       m_destImage(0),
       m_camera(nullptr)
 {
@@ -107,9 +102,31 @@ PathTracerContext::~PathTracerContext()
 {
 }
 
+void PathTracerContext::swap(PathTracerContext& other)
+{
+    // Only pointers change hands; m_bForceExit stays with the context the tasks look at.
+    m_blocks.swap(other.m_blocks);
+    std::swap(m_bResidual, other.m_bResidual);
+    std::swap(m_scene, other.m_scene);
+    std::swap(m_rt, other.m_rt);
+    std::swap(m_light, other.m_light);
+    std::swap(m_pass, other.m_pass);
+    std::swap(m_bounces, other.m_bounces);
+    std::swap(m_previewScale, other.m_previewScale);
+    m_image.swap(other.m_image);
+    m_normal.swap(other.m_normal);
+    m_position.swap(other.m_position);
+    std::swap(m_destImage, other.m_destImage);
+    std::swap(m_camera, other.m_camera);
+}
+
 PathTraceRenderer::PathTraceRenderer()
 {
     m_raysPerSecond = 0.0f;
+
+    // One pool for the lifetime of the renderer, rather than resized at the start of every pass.
+    m_launcher.setNumThreads(m_launcher.getNumCores());
+    //m_launcher.setNumThreads(1);
 }
 
 PathTraceRenderer::~PathTraceRenderer()
@@ -119,56 +136,24 @@ PathTraceRenderer::~PathTraceRenderer()
 
 Vec3f PathTraceRenderer::evalMat(const Vec3f& diffuse, const Vec3f& specular, const Vec3f& n, const Vec3f& hit2Light, const Vec3f& Rd, float glossiness)
 {
-    Vec3f L = hit2Light.normalized();
-    Vec3f V = -Rd.normalized();
-    Vec3f H = (V + L).normalized();
-
-    float NoV = FW::abs(FW::dot(n, V));
-    float NoL = FW::clamp(FW::dot(n, L), 0.0f, 1.0f);
-    float LoH = FW::clamp(FW::dot(L, H), 0.0f, 1.0f);
-    float NoH = FW::clamp(FW::dot(n, H), 0.0f, 1.0f);
-
-    float roughness = 1 - glossiness / 255;
-    float fd90 = 0.6 * roughness + 2.f * LoH * LoH * roughness;
-    float lightScatter = 1.f + (fd90 - 1.f) * FW::pow(1.f - NoL, 5.f);
-    float viewScatter = 1.f + (fd90 - 1.f) * FW::pow(1.f - NoV, 5.f);
-    // there is a dark edge on object for this equation
-    Vec3f diffuseBRDF = diffuse * m_revPI * lightScatter * viewScatter * ((1 - roughness) * 1 + roughness * (1 / 1.51));
-    // Vec3f diffuseBRDF = diffuse * m_revPI;
-
-    // Vec3f FS0 = (1 - roughness) * (specular * specular) * 0.16 + roughness * diffuse;
-    Vec3f FS0 = (1 - roughness) * diffuse + roughness * (specular * specular) * 0.16;
-    Vec3f F = FS0 + (fd90 - FS0) * FW::pow(1.f - LoH, 5.f);
-    float alphaG2 = roughness * roughness;
-    float Lambda_GGXV = NoL * sqrt((-NoV * alphaG2 + NoV) * NoV + alphaG2);
-    float Lambda_GGXL = NoV * sqrt((-NoL * alphaG2 + NoL) * NoL + alphaG2);
-    float Vis = 0.5f / (Lambda_GGXV + Lambda_GGXL);
-    float f = (NoH * alphaG2 - NoH) * NoH + 1;
-    float D = alphaG2 / (f * f);
-    Vec3f specularBRDF = D * F * Vis * m_revPI;
-
-    return (diffuseBRDF + specularBRDF);
+    return evalBrdf(diffuse, specular, n, hit2Light, -Rd, glossiness);
 }
 
 // This function traces a single path and returns the resulting color value that will get rendered on the image. 
 // Filling in the blanks here is all you need to do this time around.
 Vec3f PathTraceRenderer::tracePath(float image_x, float image_y, PathTracerContext& ctx, int samplerBase, Random& R, std::vector<PathVisualizationNode>& visualization, Vec3f& nn, Vec3f& pos, Mat4f& invP)
 {
-	const MeshWithColors* scene = ctx.m_scene;
-	RayTracer* rt = ctx.m_rt;
-	Image* image = ctx.m_image.get();
-	const CameraControls& cameraCtrl = *ctx.m_camera;
-	AreaLight* light = ctx.m_light;
-
-	// make sure we're on CPU
-	//image->getMutablePtr();
+    LightConnection c;
+    if (!traceLightConnection(image_x, image_y, ctx, R, nn, pos, invP, c))
+        return Vec3f(0.f);
 
-	// get camera orientation and projection
-	Mat4f worldToCamera = cameraCtrl.getWorldToCamera();
-	Mat4f projection = Mat4f::fitToView(Vec2f(-1, -1), Vec2f(2, 2), image->getSize())*cameraCtrl.getCameraToClip();
+    return c.weight * evalBrdf(c.diffuse, c.specular, c.n, c.toLight, c.toViewer, c.glossiness);
+}
 
-	// Simple ray generation code, you can use this if you want to.
-    //Mat4f invP = (projection * worldToCamera).inverted();
+// Casts the camera ray through a pixel, with ray differentials for texture filtering.
+static bool castPrimaryRay(float image_x, float image_y, const PathTracerContext& ctx, const Mat4f& invP, Vec3f& Ro, Vec3f& Rd, RaycastResult& result)
+{
+	const Framebuffer<Vec4f>* image = ctx.m_image.get();
 
 	// Generate a ray through the pixel.
 	float x = (float)image_x / image->getSize().x *  2.0f - 1.0f;
@@ -181,9 +166,9 @@ Vec3f PathTraceRenderer::tracePath(float image_x, float image_y, PathTracerConte
 
 	// apply inverse projection, divide by w to get object-space points
 	Vec4f Roh = (invP * P0);
-	Vec3f Ro = (Roh * (1.0f / Roh.w)).getXYZ();
+	Ro = (Roh * (1.0f / Roh.w)).getXYZ();
 	Vec4f Rdh = (invP * P1);
-	Vec3f Rd = (Rdh * (1.0f / Rdh.w)).getXYZ();
+	Rd = (Rdh * (1.0f / Rdh.w)).getXYZ();
 
 	// Subtract front plane point from back plane point,
 	// yields ray direction.
@@ -192,15 +177,60 @@ Vec3f PathTraceRenderer::tracePath(float image_x, float image_y, PathTracerConte
 	// intersections that come _after_ the point Ro+Rd are to be discarded.
 	Rd = Rd - Ro;
 
-	// if we hit something, fetch a color and insert into image
-    Vec3f throughput(1.f);
-	Vec3f Ei(0.f);
-
-    RaycastResult result = rt->raycast(Ro, Rd);
+    result = ctx.m_rt->raycast(Ro, Rd);
     if (result.tri == nullptr) {
-        return Ei;
+        return false;
     }
 
+    // Ray differentials for texture filtering: directions through the neighbouring pixels,
+    // scaled by the hit distance, approximate the pixel footprint at the hit point.
+    {
+        float dx = 2.0f / image->getSize().x;
+        float dy = -2.0f / image->getSize().y;
+        Vec4f Rohx = invP * Vec4f(x + dx, y, 0.0f, 1.0f), Rdhx = invP * Vec4f(x + dx, y, 1.0f, 1.0f);
+        Vec4f Rohy = invP * Vec4f(x, y + dy, 0.0f, 1.0f), Rdhy = invP * Vec4f(x, y + dy, 1.0f, 1.0f);
+        Vec3f D = Rd.normalized();
+        result.dDdx = ((Rdhx * (1.0f / Rdhx.w)).getXYZ() - (Rohx * (1.0f / Rohx.w)).getXYZ()).normalized() - D;
+        result.dDdy = ((Rdhy * (1.0f / Rdhy.w)).getXYZ() - (Rohy * (1.0f / Rohy.w)).getXYZ()).normalized() - D;
+        float dist = (result.point - Ro).length();
+        result.dPdx = result.dDdx * dist;
+        result.dPdy = result.dDdy * dist;
+    }
+
+    return true;
+}
+
+// Fills in the G-buffer of a pixel without shading it, for pixels a preview pass skips.
+static void tracePrimary(float image_x, float image_y, const PathTracerContext& ctx, const Mat4f& invP, Vec3f& nn, Vec3f& pos)
+{
+    Vec3f Ro, Rd;
+    RaycastResult result;
+    if (!castPrimaryRay(image_x, image_y, ctx, invP, Ro, Rd, result))
+        return;
+
+    Vec3f diffuse, n, specular;
+    PathTraceRenderer::getTextureParameters(result, diffuse, n, specular);
+    if (FW::dot(Rd, n) > 0)
+        n = -n;
+    nn = n;
+    pos = result.point + n * 0.001;
+}
+
+// Traces the camera ray and the shadow ray of a path, leaving only the BRDF to be evaluated
+// so pathTraceBlock can batch it. Returns false if the path carries no light.
+bool PathTraceRenderer::traceLightConnection(float image_x, float image_y, PathTracerContext& ctx, Random& R, Vec3f& nn, Vec3f& pos, const Mat4f& invP, LightConnection& c)
+{
+	RayTracer* rt = ctx.m_rt;
+	AreaLight* light = ctx.m_light;
+
+	Vec3f Ro, Rd;
+	RaycastResult result;
+	if (!castPrimaryRay(image_x, image_y, ctx, invP, Ro, Rd, result))
+		return false;
+
+	// if we hit something, fetch a color and insert into image
+    Vec3f throughput(1.f);
+
     // YOUR CODE HERE (R2-R4):
     // Implement path tracing with direct light and shadows, scattering and Russian roulette.
     Vec3f diffuse;
@@ -221,14 +251,117 @@ Vec3f PathTraceRenderer::tracePath(float image_x, float image_y, PathTracerConte
     Vec3f hit = result.point + n * 0.001;
     Vec3f hit2Light = lightHitPoint - hit;
     RaycastResult blockCheck = rt->raycast(hit, hit2Light);
-    Vec3f brdf = evalMat(diffuse, specular, n, hit2Light, Rd, result.tri->m_material->glossiness);
-    if (blockCheck.tri == nullptr) {
-        float cosTheta = FW::clamp(FW::dot(hit2Light.normalized(), -light->getNormal()), 0.0f, 1.0f);
-        float cosThetaY = FW::clamp(FW::dot(hit2Light.normalized(), n), 0.0f, 1.0f);
-        Ei += throughput * brdf * light->getEmission() * cosTheta * cosThetaY / (hit2Light.lenSqr() * lightPdf + 0.00001);
+    if (blockCheck.tri != nullptr) {
+        return false;
+    }
+
+    float cosTheta = FW::clamp(FW::dot(hit2Light.normalized(), -light->getNormal()), 0.0f, 1.0f);
+    float cosThetaY = FW::clamp(FW::dot(hit2Light.normalized(), n), 0.0f, 1.0f);
+
+    c.diffuse = diffuse;
+    c.specular = specular;
+    c.n = n;
+    c.toLight = hit2Light;
+    c.toViewer = -Rd;
+    c.glossiness = result.tri->m_material->glossiness;
+    c.weight = throughput * light->getEmission() * cosTheta * cosThetaY / (hit2Light.lenSqr() * lightPdf + 0.00001f);
+    return true;
+}
+
+// Indirect light reaching the camera through pixel (x, y): cosine-sampled bounces with
+// next-event estimation at every vertex after the first, whose direct light the regular
+// pass already computes. This is what the servers add to the picture.
+Vec3f PathTraceRenderer::traceIndirect(float image_x, float image_y, PathTracerContext& ctx, Random& R, const Mat4f& invP)
+{
+    RayTracer* rt = ctx.m_rt;
+    const Framebuffer<Vec4f>* image = ctx.m_image.get();
+    AreaLight* light = ctx.m_light;
+
+    float x = (float)image_x / image->getSize().x *  2.0f - 1.0f;
+    float y = (float)image_y / image->getSize().y * -2.0f + 1.0f;
+    Vec4f Roh = invP * Vec4f(x, y, 0.0f, 1.0f);
+    Vec4f Rdh = invP * Vec4f(x, y, 1.0f, 1.0f);
+    Vec3f Ro = (Roh * (1.0f / Roh.w)).getXYZ();
+    Vec3f Rd = (Rdh * (1.0f / Rdh.w)).getXYZ() - Ro;
+
+    RaycastResult result = rt->raycast(Ro, Rd);
+    if (result.tri == nullptr)
+        return Vec3f(0.f);
+
+    // Negative bounce counts mean Russian roulette from that bounce on, with a hard cap.
+    int bounces = ctx.m_bounces < 0 ? 16 : ctx.m_bounces;
+    int rouletteFrom = ctx.m_bounces < 0 ? -ctx.m_bounces : bounces + 1;
+
+    Vec3f E(0.f);
+    Vec3f throughput(1.f);
+    for (int bounce = 1; bounce <= bounces; ++bounce)
+    {
+        Vec3f diffuse, n, specular;
+        getTextureParameters(result, diffuse, n, specular);
+        if (FW::dot(Rd, n) > 0)
+            n = -n;
+        float glossiness = result.tri->m_material->glossiness;
+        Vec3f hit = result.point + n * 0.001f;
+
+        // Light arriving over the previous segment, except at the first vertex.
+        if (bounce > 1)
+        {
+            float lightPdf;
+            Vec3f lightHitPoint;
+            light->sample(lightPdf, lightHitPoint, 0, R);
+            Vec3f hit2Light = lightHitPoint - hit;
+            if (rt->raycast(hit, hit2Light).tri == nullptr)
+            {
+                float cosTheta = FW::clamp(FW::dot(hit2Light.normalized(), -light->getNormal()), 0.0f, 1.0f);
+                float cosThetaY = FW::clamp(FW::dot(hit2Light.normalized(), n), 0.0f, 1.0f);
+                E += throughput * light->getEmission() * evalBrdf(diffuse, specular, n, hit2Light, -Rd, glossiness)
+                    * cosTheta * cosThetaY / (hit2Light.lenSqr() * lightPdf + 0.00001f);
+            }
+        }
+
+        if (bounce >= rouletteFrom)
+        {
+            if (R.getF32() >= 0.5f)
+                break;
+            throughput *= 2.0f;
+        }
+
+        // Cosine-weighted direction; the cosine and pdf cancel to a factor of pi.
+        float r = FW::sqrt(R.getF32());
+        float phi = 2.0f * FW_PI * R.getF32();
+        Vec3f d = formBasis(n) * Vec3f(r * FW::cos(phi), r * FW::sin(phi), FW::sqrt(FW::max(0.0f, 1.0f - r * r)));
+        throughput *= evalBrdf(diffuse, specular, n, d, -Rd, glossiness) * FW_PI;
+
+        Rd = d * s_bounceRayLength;
+        result = rt->raycast(hit, Rd);
+        if (result.tri == nullptr)
+            break;
     }
+    return E;
+}
 
-	return Ei;
+static Mat4f getInverseProjection(const PathTracerContext& ctx)
+{
+    Mat4f worldToCamera = ctx.m_camera->getWorldToCamera();
+    Mat4f projection = Mat4f::fitToView(Vec2f(-1,-1), Vec2f(2,2), ctx.m_image->getSize())*ctx.m_camera->getCameraToClip();
+    return (projection * worldToCamera).inverted();
+}
+
+// The image is split into one band of rows per NUMA node the workers run on.
+static int getRowNode(int y, int height)
+{
+    return height ? (int)((S64)y * MulticoreLauncher::getNumNodes() / height) : 0;
+}
+
+// Clears one block-high row range of the pass buffers.
+void PathTraceRenderer::clearBlock( MulticoreLauncher::Task& t )
+{
+    PathTracerContext& ctx = *(PathTracerContext*)t.data;
+    int y0 = t.idx * s_blockSize;
+    int y1 = FW::min(y0 + s_blockSize, ctx.m_image->getHeight());
+    ctx.m_image->clearRows(y0, y1);
+    ctx.m_normal->clearRows(y0, y1);
+    ctx.m_position->clearRows(y0, y1);
 }
 
 // This function is responsible for asynchronously generating paths for a given block.
@@ -238,21 +371,13 @@ void PathTraceRenderer::pathTraceBlock( MulticoreLauncher::Task& t )
 
     const MeshWithColors* scene			= ctx.m_scene;
     RayTracer* rt						= ctx.m_rt;
-    Image* image						= ctx.m_image.get();
-    Image* normal                       = ctx.m_normal.get();
-    Image* position                     = ctx.m_position.get();
-    const CameraControls& cameraCtrl	= *ctx.m_camera;
+    Framebuffer<Vec4f>* image			= ctx.m_image.get();
+    Framebuffer<Vec3f>* normal          = ctx.m_normal.get();
+    Framebuffer<Vec3f>* position        = ctx.m_position.get();
     AreaLight* light					= ctx.m_light;
 
-    // make sure we're on CPU
-    image->getMutablePtr();
-
-    // get camera orientation and projection
-    Mat4f worldToCamera = cameraCtrl.getWorldToCamera();
-    Mat4f projection = Mat4f::fitToView(Vec2f(-1,-1), Vec2f(2,2), image->getSize())*cameraCtrl.getCameraToClip();
-
     // inverse projection from clip space to world space
-    Mat4f invP = (projection * worldToCamera).inverted();
+    Mat4f invP = getInverseProjection(ctx);
 
     // get the block which we are rendering
     PathTracerBlock& block = ctx.m_blocks[t.idx];
@@ -264,6 +389,23 @@ void PathTraceRenderer::pathTraceBlock( MulticoreLauncher::Task& t )
 	uint32_t current_seed = seed.fetch_add(1);
 	Random R(t.idx + current_seed);	// this is bogus, just to make the random numbers change each iteration
 
+    // Lit samples are queued and their BRDFs evaluated a batch at a time; each batch entry
+    // remembers the pixel it belongs to and the weight to apply to the result.
+    int spp = block.m_spp;
+    float sampleScale = 1.0f / spp;
+    std::vector<Vec3f> blockEi(block.m_width * block.m_height, Vec3f(0.f));
+    BrdfBatch batch;
+    int batchPixel[BrdfBatch::Capacity];
+    Vec3f batchWeight[BrdfBatch::Capacity];
+
+    auto flushBatch = [&]()
+    {
+        evalBrdfBatch(batch);
+        for (int b = 0; b < batch.count; ++b)
+            blockEi[batchPixel[b]] += batchWeight[b] * batch.getResult(b);
+        batch.clear();
+    };
+
     for ( int i = 0; i < block.m_width * block.m_height; ++i )
     {
         if( ctx.m_bForceExit ) {
@@ -274,53 +416,129 @@ void PathTraceRenderer::pathTraceBlock( MulticoreLauncher::Task& t )
         int pixel_x = block.m_x + (i % block.m_width);
         int pixel_y = block.m_y + (i / block.m_width);
 
-        int spp = m_spp;
-        Vec3f Ei(0);
-
         Vec3f n(0);
         Vec3f pos(0);
 
+        // Preview passes only fill in the G-buffer between the pixels they shade, to guide
+        // the upsampling once the pass is done.
+        int scale = ctx.m_previewScale;
+        if (scale > 1 && (pixel_x % scale || pixel_y % scale)) {
+            tracePrimary(pixel_x, pixel_y, ctx, invP, n, pos);
+            normal->getRow(pixel_y)[pixel_x] = n;
+            position->getRow(pixel_y)[pixel_x] = pos;
+            continue;
+        }
+
         for (int k = 0; k < spp; ++k) {
-            Ei += tracePath(pixel_x, pixel_y, ctx, 0, R, dummyVisualization, n, pos, invP) / spp;
+            // A cancelled pass drops the block; nothing has been written to the image yet.
+            if (ctx.m_bForceExit.load(std::memory_order_relaxed))
+                return;
+
+            LightConnection c;
+            if (!traceLightConnection(pixel_x, pixel_y, ctx, R, n, pos, invP, c))
+                continue;
+
+            int b = batch.add(c.diffuse, c.specular, c.n, c.toLight, c.toViewer, c.glossiness);
+            batchPixel[b] = i;
+            batchWeight[b] = c.weight * sampleScale;
+            if (batch.isFull())
+                flushBatch();
         }
 
-        // Put pixel.
-        Vec4f prev = image->getVec4f( Vec2i(pixel_x, pixel_y) );
-        prev += Vec4f( Ei, 1.0f );
-        image->setVec4f( Vec2i(pixel_x, pixel_y), prev );
+        normal->getRow(pixel_y)[pixel_x] = n;
+        position->getRow(pixel_y)[pixel_x] = pos;
+    }
+    flushBatch();
+
+    // Put pixels.
+    for (int i = 0; i < block.m_width * block.m_height; ++i)
+    {
+        int pixel_x = block.m_x + (i % block.m_width);
+        int pixel_y = block.m_y + (i / block.m_width);
+        image->getRow(pixel_y)[pixel_x] += Vec4f( blockEi[i], 1.0f );
+    }
+}
+
+// Adds one indirect sample per pixel of a backfill block to the pass buffer.
+void PathTraceRenderer::backfillBlock( MulticoreLauncher::Task& t )
+{
+    PathTraceRenderer& renderer = *(PathTraceRenderer*)t.data;
+    PathTracerContext& ctx = renderer.m_context;
+    const PathTracerBlock& block = renderer.m_backfillBlocks[t.idx];
+    Mat4f invP = getInverseProjection(ctx);
+
+    static std::atomic<uint32_t> seed = 0;
+    Random R(t.idx + seed.fetch_add(1));
+    int scale = ctx.m_previewScale;
 
-        normal->setVec4f(Vec2i(pixel_x, pixel_y), Vec4f(n, 0.f));
-        position->setVec4f(Vec2i(pixel_x, pixel_y), Vec4f(pos, 0.f));
+    for (int i = 0; i < block.m_height; ++i)
+    {
+        Vec4f* row = renderer.m_backfillPass.getRow(block.m_y + i) + block.m_x;
+        for (int j = 0; j < block.m_width; ++j)
+        {
+            if (ctx.m_bForceExit)
+                return;
+            if (scale > 1 && ((block.m_x + j) % scale || (block.m_y + i) % scale))
+                row[j] = Vec4f(0.0f);
+            else
+                row[j] = Vec4f(traceIndirect((float)(block.m_x + j), (float)(block.m_y + i), ctx, R, invP), 1.0f);
+        }
     }
 }
 
 void PathTraceRenderer::startPathTracingProcess( const MeshWithColors* scene, AreaLight* light, RayTracer* rt, Image* dest, int bounces, const CameraControls& camera )
 {
     FW_ASSERT( !m_context.m_bForceExit );
+    FW_ASSERT( !isRunning() );
 
-    m_context.m_bForceExit = false;
-    m_context.m_bResidual = false;
-    m_context.m_camera = &camera;
-    m_context.m_rt = rt;
-    m_context.m_scene = scene;
-    m_context.m_light = light;
-    m_context.m_pass = 0;
-    m_context.m_bounces = bounces;
-    m_context.m_image.reset(new Image( dest->getSize(), ImageFormat::RGBA_Vec4f));
-    m_context.m_normal.reset(new Image(dest->getSize(), ImageFormat::RGBA_Vec4f));
-    m_context.m_position.reset(new Image(dest->getSize(), ImageFormat::RGBA_Vec4f));
-
-    m_context.m_destImage = dest;
-    m_context.m_image->clear();
-    m_context.m_normal->clear();
-    m_context.m_position->clear();
-
-    // Add rendering blocks.
-    m_context.m_blocks.clear();
+    prepareContext(m_context, scene, light, rt, dest, bounces, camera);
+    launchPass();
+}
+
+void PathTraceRenderer::prepareContext( PathTracerContext& ctx, const MeshWithColors* scene, AreaLight* light, RayTracer* rt, Image* dest, int bounces, const CameraControls& camera )
+{
+    ctx.m_bResidual = false;
+    ctx.m_camera = &camera;
+    ctx.m_rt = rt;
+    ctx.m_scene = scene;
+    ctx.m_light = light;
+    ctx.m_pass = 0;
+    ctx.m_bounces = bounces;
+    ctx.m_previewScale = m_previewScale;
+    ctx.m_destImage = dest;
+
+    // Buffers are kept from pass to pass and only reallocated when the size changes.
+    Vec2i size = dest->getSize();
+    if (!ctx.m_image)
     {
-        int block_size = 32;
-        int image_width = dest->getSize().x;
-        int image_height = dest->getSize().y;
+        ctx.m_image.reset(new Framebuffer<Vec4f>);
+        ctx.m_normal.reset(new Framebuffer<Vec3f>);
+        ctx.m_position.reset(new Framebuffer<Vec3f>);
+    }
+    ctx.m_image->resize(size);
+    ctx.m_normal->resize(size);
+    ctx.m_position->resize(size);
+
+    // Cleared by the workers of the NUMA node that renders the rows, which places freshly
+    // allocated pages on that node. A launcher of its own, so only these tasks are waited for.
+    {
+        MulticoreLauncher launcher;
+        int numChunks = (size.y + s_blockSize - 1) / s_blockSize;
+        for (int first = 0, last; first < numChunks; first = last)
+        {
+            int node = getRowNode(first * s_blockSize, size.y);
+            for (last = first + 1; last < numChunks && getRowNode(last * s_blockSize, size.y) == node; ++last);
+            launcher.push(clearBlock, &ctx, first, last - first, node);
+        }
+        launcher.popAll();
+    }
+
+    // Add rendering blocks. The vector keeps its capacity, so this does not allocate either.
+    ctx.m_blocks.clear();
+    {
+        int block_size = s_blockSize;
+        int image_width = size.x;
+        int image_height = size.y;
         int block_count_x = (image_width + block_size - 1) / block_size;
         int block_count_y = (image_height + block_size - 1) / block_size;
 
@@ -339,55 +557,274 @@ void PathTraceRenderer::startPathTracingProcess( const MeshWithColors* scene, Ar
                 block.m_y = block_size * y;
                 block.m_width = block_width;
                 block.m_height = block_height;
+                block.m_priority = getFoveaPriority(m_foveation, size, block.m_x, block.m_y, block_width, block_height);
+                block.m_spp = getFoveatedSamples(m_foveation, m_spp, block.m_priority);
+                block.m_node = getRowNode(block.m_y, image_height);
 
-                m_context.m_blocks.push_back(block);
+                ctx.m_blocks.push_back(block);
             }
         }
+
+        // Grouped by node, and the launcher hands tasks out in index order, so each node
+        // does its part of the fovea first.
+        std::stable_sort(ctx.m_blocks.begin(), ctx.m_blocks.end(),
+            [](const PathTracerBlock& a, const PathTracerBlock& b) { return (a.m_node != b.m_node) ? a.m_node < b.m_node : a.m_priority > b.m_priority; });
+    }
+}
+
+void PathTraceRenderer::launchPass()
+{
+    Image* dest = m_context.m_destImage;
+
+    // Indirect light belongs to an epoch, not to a local pass: restarts that leave the epoch
+    // alone (local spp, kernel, ...) keep it, since delta-mode servers will not resend it.
+    U32 epoch = m_context.m_camera->getEpoch();
+    if (!m_hasIndirect || epoch != m_indirectEpoch || m_indirect.getSize() != dest->getSize())
+    {
+        m_indirect.resize(dest->getSize());
+        m_indirect.clear();
+        m_localIndirect.resize(dest->getSize());
+        m_localIndirect.clear();
+        m_numBackfillPasses = 0;
+        m_hasIndirect = true;
+        m_indirectEpoch = epoch;
     }
+    m_backfillPass.resize(dest->getSize());
+    m_backfilling = false;
 
     dest->clear();
 
     m_notDenoised = true;
 
-    // Fire away!
+    // Fire away! The worker threads were started by the constructor and stay around. Each
+    // node's blocks go to its own workers, which cleared those rows in prepareContext.
 
-    // std::cout << "hehe" << std::endl;
+    const std::vector<PathTracerBlock>& blocks = m_context.m_blocks;
+    for (int first = 0, last; first < (int)blocks.size(); first = last)
+    {
+        for (last = first + 1; last < (int)blocks.size() && blocks[last].m_node == blocks[first].m_node; ++last);
+        m_launcher.push( pathTraceBlock, &m_context, first, last - first, blocks[first].m_node );
+    }
+}
 
-    // If you change this, change the one in checkFinish too.
-    m_launcher.setNumThreads(m_launcher.getNumCores());
-    //m_launcher.setNumThreads(1);
+void PathTraceRenderer::releaseBuffers()
+{
+    stop();
+    for (PathTracerContext* ctx : { &m_context, &m_nextContext })
+    {
+        ctx->m_image.reset();
+        ctx->m_normal.reset();
+        ctx->m_position.reset();
+    }
+}
+
+void PathTraceRenderer::addIndirectTile(int vStart, const FrameTile& tile, const FrameDecoder& decoder, F32 replaceWeight)
+{
+    FW_ASSERT(vStart + tile.y + tile.height <= m_indirect.getHeight() && tile.x + tile.width <= m_indirect.getWidth());
 
+    // Full frames replace the strip, weighted by the samples behind them, delta tiles add
+    // their samples to it. Pixels are decoded straight from the received message into the
+    // indirect buffer.
+    for (int i = 0; i < tile.height; ++i)
+        decoder.accumulateRow(tile, i, m_indirect.getRow(vStart + tile.y + i) + tile.x, replaceWeight);
+}
+
+void PathTraceRenderer::addPreviewTile(int x0, int y0, int scale, const FrameTile& tile, const FrameDecoder& decoder, F32 replaceWeight)
+{
+    FW_ASSERT(y0 + (tile.y + tile.height - 1) * scale < m_indirect.getHeight() && x0 + (tile.x + tile.width - 1) * scale < m_indirect.getWidth());
+
+    // Values land on every scale-th pixel, where upsamplePreview looks for them.
+    std::vector<Vec4f> row(tile.width);
+    for (int i = 0; i < tile.height; ++i)
+    {
+        Vec4f* dst = m_indirect.getRow(y0 + (tile.y + i) * scale) + x0 + tile.x * scale;
+        for (int j = 0; j < tile.width; ++j)
+            row[j] = dst[j * scale];
+        decoder.accumulateRow(tile, i, row.data(), replaceWeight);
+        for (int j = 0; j < tile.width; ++j)
+            dst[j * scale] = row[j];
+    }
+}
+
+bool PathTraceRenderer::startBackfill(const std::vector<Vec2i>& rowRanges)
+{
+    FW_ASSERT(!isRunning());
+    if (m_numBackfillPasses >= s_maxBackfillPasses || !m_context.m_rt)
+        return false;
+
+    // 32x32 blocks like the regular pass, clipped to the requested rows.
+    const int block_size = 32;
+    int image_width = m_localIndirect.getWidth();
+    m_backfillBlocks.clear();
+    for (const Vec2i& range : rowRanges)
+    for (int y = range.x; y < range.y; y += block_size)
+    for (int x = 0; x < image_width; x += block_size)
+    {
+        PathTracerBlock block;
+        block.m_x = x;
+        block.m_y = y;
+        block.m_width = FW::min(block_size, image_width - x);
+        block.m_height = FW::min(block_size, range.y - y);
+        m_backfillBlocks.push_back(block);
+    }
+    if (m_backfillBlocks.empty())
+        return false;
+
+    m_backfilling = true;
+    m_numBackfillPasses++;
+    m_launcher.push(backfillBlock, this, 0, (int)m_backfillBlocks.size());
+    return true;
+}
+
+bool PathTraceRenderer::finishBackfill(int& rowStart, int& rowEnd)
+{
+    if (!m_backfilling || m_launcher.getNumTasks() != m_launcher.getNumFinished())
+        return false;
     m_launcher.popAll();
-    m_launcher.push( pathTraceBlock, &m_context, 0, (int)m_context.m_blocks.size() );
+    m_backfilling = false;
+
+    // Only now is the pass visible to blendFrame, which runs on this thread.
+    rowStart = m_localIndirect.getHeight();
+    rowEnd = 0;
+    for (const PathTracerBlock& block : m_backfillBlocks)
+    {
+        for (int i = block.m_y; i < block.m_y + block.m_height; ++i)
+        {
+            const Vec4f* src = m_backfillPass.getRow(i) + block.m_x;
+            Vec4f* dst = m_localIndirect.getRow(i) + block.m_x;
+            for (int j = 0; j < block.m_width; ++j)
+                dst[j] += src[j];
+        }
+        rowStart = FW::min(rowStart, block.m_y);
+        rowEnd = FW::max(rowEnd, block.m_y + block.m_height);
+    }
+    return true;
+}
+
+// Joint bilateral upsampling of a buffer that only holds values at pixels whose coordinates
+// are multiples of scale: the four such pixels around (j, i) are weighted bilinearly and by
+// how well their normal and position match the pixel's own, so light does not bleed across
+// edges. Falls back to plain bilinear weights where no neighbour matches.
+static Vec4f upsamplePreview(const PathTracerContext& ctx, const Framebuffer<Vec4f>& buf, int j, int i, int scale)
+{
+    constexpr float inv_sigmaPlane = 1.f / (2.f * 0.1f * 0.1f);
+    constexpr float inv_sigmaNormal = 1.f / (2.f * 0.1f * 0.1f);
+
+    int x0 = j - j % scale;
+    int y0 = i - i % scale;
+    if (x0 == j && y0 == i)
+        return buf(j, i);
+
+    const Framebuffer<Vec3f>& normal = *ctx.m_normal;
+    const Framebuffer<Vec3f>& position = *ctx.m_position;
+    Vec3f nn = normal(j, i);
+    Vec3f pos = position(j, i);
+    Vec4f D(0), B(0);
+    float D_weight = 0, B_weight = 0;
+
+    for (int k = 0; k < 4; ++k)
+    {
+        int x = x0 + (k & 1) * scale;
+        int y = y0 + (k >> 1) * scale;
+        if (x >= buf.getWidth() || y >= buf.getHeight())
+            continue;
+
+        float bilinear = (1.0f - (float)abs(x - j) / scale) * (1.0f - (float)abs(y - i) / scale);
+        float dis_n = acos(min(max(dot(nn, normal(x, y)), 0.f), 1.f));
+        dis_n = dis_n * dis_n * inv_sigmaNormal;
+        Vec3f d = position(x, y) - pos;
+        float D_plane = d.lenSqr() > 0.0f ? dot(nn, d.normalized()) : 0.0f;
+        D_plane = D_plane * D_plane * inv_sigmaPlane;
+
+        float weight = bilinear * exp(-D_plane - dis_n);
+        D += buf(x, y) * weight;
+        D_weight += weight;
+        B += buf(x, y) * bilinear;
+        B_weight += bilinear;
+    }
+
+    if (D_weight > 1.0e-4f)
+        return D / D_weight;
+    return B_weight > 0.0f ? B / B_weight : Vec4f(0.0f);
 }
 
 void PathTraceRenderer::blendFrame(Image* dest, int vStart, int vHeight)
 {
+    const Framebuffer<Vec4f>& image = *m_context.m_image;
+    Vec4fImageRows destRows(*dest);
+    int width = dest->getSize().x;
+    int scale = m_context.m_previewScale;
+
 #pragma omp parallel for
     for (int i = 0; i < vHeight; ++i)
     {
-        for (int j = 0; j < dest->getSize().x; ++j)
+        const Vec4f* src = image.getRow(i + vStart);
+        const Vec4f* indirect = m_indirect.getRow(i + vStart);
+        const Vec4f* local = m_localIndirect.getRow(i + vStart);
+        Vec4f* dst = destRows.getRow(i + vStart);
+
+        // Server and backfilled indirect light are averaged by sample weight, normalized
+        // and rescaled to the local sample weight so the resolve divides both by the same w.
+        for (int j = 0; j < width; ++j)
         {
-            Vec4f D = m_context.m_image->getVec4f(Vec2i(j, i + vStart));
-
-            D.x += pixelColor[i * dest->getSize().x + j].r;
-            D.y += pixelColor[i * dest->getSize().x + j].g;
-            D.z += pixelColor[i * dest->getSize().x + j].b;
-
-            if (D.w != 0.0f)
-                D = D * (1.0f / D.w);
+            Vec4f sum = indirect[j] + local[j];
+            if (scale > 1)
+                sum = upsamplePreview(m_context, m_indirect, j, i + vStart, scale) + upsamplePreview(m_context, m_localIndirect, j, i + vStart, scale);
+            float weightScale = sum.w != 0.0f ? src[j].w / sum.w : 0.0f;
+            dst[j] = src[j] + Vec4f(sum.getXYZ() * weightScale, 0.0f);
+        }
 
-            // Gamma correction.
-            Vec4f color = Vec4f(
-                FW::pow(D.x, 1.0f / 2.2f),
-                FW::pow(D.y, 1.0f / 2.2f),
-                FW::pow(D.z, 1.0f / 2.2f),
-                D.w
-            );
+        resolveRow(dst, dst, width, m_resolveParams);
+    }
+}
 
-            dest->setVec4f(Vec2i(j, i + vStart), color);
+// Joint bilateral filter of the accumulated image at pixel (j, i), guided by the normal and position buffers.
+static Vec4f filterPixelJBF(const PathTracerContext& ctx, int j, int i, int kernel)
+{
+    constexpr float inv_sigmaPlane = 1.f / (2.f * 0.1f * 0.1f);
+    constexpr float inv_sigmaColor = 1.f / (2.f * 0.6f * 0.6f);
+    constexpr float inv_sigmaNormal = 1.f / (2.f * 0.1f * 0.1f);
+    constexpr float inv_sigmaCoord = 1.f / (2.f * 32.0f * 32.0f);
+
+    const Framebuffer<Vec4f>& image = *ctx.m_image;
+    const Framebuffer<Vec3f>& normal = *ctx.m_normal;
+    const Framebuffer<Vec3f>& position = *ctx.m_position;
+
+    int x_start = max(0, j - kernel);
+    int x_end = min(image.getWidth() - 1, j + kernel);
+    int y_start = max(0, i - kernel);
+    int y_end = min(image.getHeight() - 1, i + kernel);
+
+    Vec4f cc = image(j, i);
+    Vec3f nn = normal(j, i);
+    Vec3f pos = position(j, i);
+    Vec4f D(0);
+    float D_weight = 0;
+
+    for (int y = y_start; y <= y_end; y++) {
+        const Vec4f* imageRow = image.getRow(y);
+        const Vec3f* normalRow = normal.getRow(y);
+        const Vec3f* positionRow = position.getRow(y);
+
+        for (int x = x_start; x <= x_end; x++) {
+            const Vec4f& tmp_cc = imageRow[x];
+            const Vec3f& tmp_nn = normalRow[x];
+            const Vec3f& tmp_pos = positionRow[x];
+            float dis_pos = (Vec2i(j, i) - Vec2i(x, y)).lenSqr() * inv_sigmaCoord;
+            float dis_color = (cc - tmp_cc).lenSqr() * inv_sigmaColor;
+            float dis_n = acos(min(max(dot(nn, tmp_nn), 0.f), 1.f));
+            dis_n = dis_n * dis_n * inv_sigmaNormal;
+
+            float D_plane = dot(nn, (tmp_pos - pos).normalized());
+            D_plane = D_plane * D_plane * inv_sigmaPlane;
+
+            float weight = exp(-D_plane - dis_pos - dis_color - dis_n);
+            D_weight += weight;
+            D += tmp_cc * weight;
         }
     }
+
+    return D.lenSqr() == 0 ? cc : D / D_weight;
 }
 
 void PathTraceRenderer::updatePicture( Image* dest )
@@ -395,244 +832,102 @@ void PathTraceRenderer::updatePicture( Image* dest )
     FW_ASSERT( m_context.m_image != 0 );
     FW_ASSERT( m_context.m_image->getSize() == dest->getSize() );
 
-    if (m_JBF) {
-        int kernel = m_kernel;
-        constexpr float inv_sigmaPlane = 1.f / (2.f * 0.1f * 0.1f);
-        constexpr float inv_sigmaColor = 1.f / (2.f * 0.6f * 0.6f);
-        constexpr float inv_sigmaNormal = 1.f / (2.f * 0.1f * 0.1f);
-        constexpr float inv_sigmaCoord = 1.f / (2.f * 32.0f * 32.0f);
+    const Framebuffer<Vec4f>& image = *m_context.m_image;
+    Vec4fImageRows destRows(*dest);
 
 #pragma omp parallel for
-        for (int i = 0; i < dest->getSize().y; ++i)
+    for (int i = 0; i < dest->getSize().y; ++i)
+    {
+        const Vec4f* src = image.getRow(i);
+        Vec4f* dst = destRows.getRow(i);
+
+        // While a preview pass runs, skipped pixels show the nearest shaded one.
+        int scale = m_context.m_previewScale;
+        if (scale > 1)
         {
+            const Vec4f* shaded = image.getRow(i - i % scale);
             for (int j = 0; j < dest->getSize().x; ++j)
-            {
-                int x_start = max(0, j - kernel);
-                int x_end = min(dest->getSize().x - 1, j + kernel);
-                int y_start = max(0, i - kernel);
-                int y_end = min(dest->getSize().y - 1, i + kernel);
-
-                Vec4f cc = m_context.m_image->getVec4f(Vec2i(j, i));
-                Vec3f nn = m_context.m_normal->getVec4f(Vec2i(j, i)).getXYZ();
-                Vec3f pos = m_context.m_position->getVec4f(Vec2i(j, i)).getXYZ();
-                Vec4f D(0);
-                float D_weight = 0;
-
-                for (int x = x_start; x <= x_end; x++) {
-                    for (int y = y_start; y <= y_end; y++) {
-                        Vec4f tmp_cc = m_context.m_image->getVec4f(Vec2i(x, y));
-                        Vec3f tmp_nn = m_context.m_normal->getVec4f(Vec2i(x, y)).getXYZ();
-                        Vec3f tmp_pos = m_context.m_position->getVec4f(Vec2i(x, y)).getXYZ();
-                        float dis_pos = (Vec2i(j, i) - Vec2i(x, y)).lenSqr() * inv_sigmaCoord;
-                        float dis_color = (cc - tmp_cc).lenSqr() * inv_sigmaColor;
-                        float dis_n = acos(min(max(dot(nn, tmp_nn), 0.f), 1.f));
-                        dis_n = dis_n * dis_n * inv_sigmaNormal;
-
-                        float D_plane = D_plane = dot(nn, (tmp_pos - pos).normalized());
-                        D_plane = D_plane * D_plane * inv_sigmaPlane;
-
-                        float weight = exp(-D_plane - dis_pos - dis_color - dis_n);
-                        D_weight += weight;
-                        D += tmp_cc * weight;
-                    }
-                }
-
-                D = D.lenSqr() == 0 ? cc : D / D_weight;
-
-                if (D.w != 0.0f)
-                    D = D * (1.0f / D.w);
-
-                // Gamma correction.
-                Vec4f color = Vec4f(
-                    FW::pow(D.x, 1.0f / 2.2f),
-                    FW::pow(D.y, 1.0f / 2.2f),
-                    FW::pow(D.z, 1.0f / 2.2f),
-                    D.w
-                );
-
-                dest->setVec4f(Vec2i(j, i), color);
-            }
+                dst[j] = shaded[j - j % scale];
+            resolveRow(dst, dst, dest->getSize().x, m_resolveParams);
+            continue;
         }
-    }
-    else
-    {
-#pragma omp parallel for
-        for (int i = 0; i < dest->getSize().y; ++i)
+
+        if (m_JBF)
         {
             for (int j = 0; j < dest->getSize().x; ++j)
-            {
-                Vec4f D = m_context.m_image->getVec4f(Vec2i(j, i));
-                if (D.w != 0.0f)
-                    D = D * (1.0f / D.w);
-
-                // Gamma correction.
-                Vec4f color = Vec4f(
-                    FW::pow(D.x, 1.0f / 2.2f),
-                    FW::pow(D.y, 1.0f / 2.2f),
-                    FW::pow(D.z, 1.0f / 2.2f),
-                    D.w
-                );
-
-                dest->setVec4f(Vec2i(j, i), color);
-            }
+                dst[j] = filterPixelJBF(m_context, j, i, m_kernel);
+            src = dst;
         }
+
+        resolveRow(dst, src, dest->getSize().x, m_resolveParams);
     }
+}
 
-//    if (m_JBF) {
-//        int kernel = m_kernel;
-//        constexpr float inv_sigmaPlane = 1.f / (2.f * 0.1f * 0.1f);
-//        constexpr float inv_sigmaColor = 1.f / (2.f * 0.6f * 0.6f);
-//        constexpr float inv_sigmaNormal = 1.f / (2.f * 0.1f * 0.1f);
-//        constexpr float inv_sigmaCoord = 1.f / (2.f * 32.0f * 32.0f);
-//
-//#pragma omp parallel for
-//        for (int i = 0; i < dest->getSize().y; ++i)
-//        {
-//            for (int j = 0; j < dest->getSize().x; ++j)
-//            {
-//                int x_start = max(0, j - kernel);
-//                int x_end = min(dest->getSize().x - 1, j + kernel);
-//                int y_start = max(0, i - kernel);
-//                int y_end = min(dest->getSize().y - 1, i + kernel);
-//
-//                Vec4f cc = m_context.m_image->getVec4f(Vec2i(j, i));
-//                Vec3f nn = m_context.m_normal->getVec4f(Vec2i(j, i)).getXYZ();
-//                Vec3f pos = m_context.m_position->getVec4f(Vec2i(j, i)).getXYZ();
-//                Vec4f D(0);
-//                float D_weight = 0;
-//
-//                for (int x = x_start; x <= x_end; x++) {
-//                    for (int y = y_start; y <= y_end; y++) {
-//                        Vec4f tmp_cc = m_context.m_image->getVec4f(Vec2i(x, y));
-//                        Vec3f tmp_nn = m_context.m_normal->getVec4f(Vec2i(x, y)).getXYZ();
-//                        Vec3f tmp_pos = m_context.m_position->getVec4f(Vec2i(x, y)).getXYZ();
-//                        float dis_pos = (Vec2i(j, i) - Vec2i(x, y)).lenSqr() * inv_sigmaCoord;
-//                        float dis_color = (cc - tmp_cc).lenSqr() * inv_sigmaColor;
-//                        float dis_n = acos(min(max(dot(nn, tmp_nn), 0.f), 1.f));
-//                        dis_n = dis_n * dis_n * inv_sigmaNormal;
-//
-//                        float D_plane = D_plane = dot(nn, (tmp_pos - pos).normalized());
-//                        D_plane = D_plane * D_plane * inv_sigmaPlane;
-//
-//                        float weight = exp(-D_plane - dis_pos - dis_color - dis_n);
-//                        D_weight += weight;
-//                        D += tmp_cc * weight;
-//                    }
-//                }
-//
-//                D = D.lenSqr() == 0 ? m_context.m_image->getVec4f(Vec2i(j, i)) : D / D_weight;
-//
-//                if (D.w != 0.0f)
-//                    D = D * (1.0f / D.w);
-//
-//                // Gamma correction.
-//                Vec4f color = Vec4f(
-//                    FW::pow(D.x, 1.0f / 2.2f),
-//                    FW::pow(D.y, 1.0f / 2.2f),
-//                    FW::pow(D.z, 1.0f / 2.2f),
-//                    D.w
-//                );
-//
-//                dest->setVec4f(Vec2i(j, i), color);
-//            }
-//        }
-//    }
-//    else
-//    {
-//#pragma omp parallel for
-//        for (int i = 0; i < dest->getSize().y; ++i)
-//        {
-//            for (int j = 0; j < dest->getSize().x; ++j)
-//            {
-//                Vec4f D = m_context.m_image->getVec4f(Vec2i(j, i));
-//                if (D.w != 0.0f)
-//                    D = D * (1.0f / D.w);
-//
-//                // Gamma correction.
-//                Vec4f color = Vec4f(
-//                    FW::pow(D.x, 1.0f / 2.2f),
-//                    FW::pow(D.y, 1.0f / 2.2f),
-//                    FW::pow(D.z, 1.0f / 2.2f),
-//                    D.w
-//                );
-//
-//                dest->setVec4f(Vec2i(j, i), color);
-//            }
-//        }
-//    }
+void PathTraceRenderer::resolve(Image* dest)
+{
+    if (!m_context.m_image || m_context.m_image->getSize() != dest->getSize() || m_indirect.getSize() != dest->getSize())
+        return;
+
+    // Same as the render loop shows: the direct light while a pass runs, the blend afterwards.
+    if (isRunning() && !m_backfilling)
+        updatePicture(dest);
+    else
+        blendFrame(dest, 0, dest->getSize().y);
 }
 
 void PathTraceRenderer::denoise(Image* dest)
 {
-    if (m_JBF) {
-        int kernel = m_kernel;
-        constexpr float inv_sigmaPlane = 1.f / (2.f * 0.1f * 0.1f);
-        constexpr float inv_sigmaColor = 1.f / (2.f * 0.6f * 0.6f);
-        constexpr float inv_sigmaNormal = 1.f / (2.f * 0.1f * 0.1f);
-        constexpr float inv_sigmaCoord = 1.f / (2.f * 32.0f * 32.0f);
-    
+    if (!m_JBF)
+        return;
+
+    Vec4fImageRows destRows(*dest);
+
 #pragma omp parallel for
-        for (int i = 0; i < dest->getSize().y; ++i)
-        {
-            for (int j = 0; j < dest->getSize().x; ++j)
-            {
-                int x_start = max(0, j - kernel);
-                int x_end = min(dest->getSize().x - 1, j + kernel);
-                int y_start = max(0, i - kernel);
-                int y_end = min(dest->getSize().y - 1, i + kernel);
-    
-                Vec4f cc = m_context.m_image->getVec4f(Vec2i(j, i));
-                Vec3f nn = m_context.m_normal->getVec4f(Vec2i(j, i)).getXYZ();
-                Vec3f pos = m_context.m_position->getVec4f(Vec2i(j, i)).getXYZ();
-                Vec4f D(0);
-                float D_weight = 0;
-    
-                for (int x = x_start; x <= x_end; x++) {
-                    for (int y = y_start; y <= y_end; y++) {
-                        Vec4f tmp_cc = m_context.m_image->getVec4f(Vec2i(x, y));
-                        Vec3f tmp_nn = m_context.m_normal->getVec4f(Vec2i(x, y)).getXYZ();
-                        Vec3f tmp_pos = m_context.m_position->getVec4f(Vec2i(x, y)).getXYZ();
-                        float dis_pos = (Vec2i(j, i) - Vec2i(x, y)).lenSqr() * inv_sigmaCoord;
-                        float dis_color = (cc - tmp_cc).lenSqr() * inv_sigmaColor;
-                        float dis_n = acos(min(max(dot(nn, tmp_nn), 0.f), 1.f));
-                        dis_n = dis_n * dis_n * inv_sigmaNormal;
-    
-                        float D_plane = D_plane = dot(nn, (tmp_pos - pos).normalized());
-                        D_plane = D_plane * D_plane * inv_sigmaPlane;
-    
-                        float weight = exp(-D_plane - dis_pos - dis_color - dis_n);
-                        D_weight += weight;
-                        D += tmp_cc * weight;
-                    }
-                }
-    
-                D = D.lenSqr() == 0 ? m_context.m_image->getVec4f(Vec2i(j, i)) : D / D_weight;
-    
-                if (D.w != 0.0f)
-                    D = D * (1.0f / D.w);
-    
-                // Gamma correction.
-                Vec4f color = Vec4f(
-                    FW::pow(D.x, 1.0f / 2.2f),
-                    FW::pow(D.y, 1.0f / 2.2f),
-                    FW::pow(D.z, 1.0f / 2.2f),
-                    D.w
-                );
-    
-                dest->setVec4f(Vec2i(j, i), color);
-            }
-        }
+    for (int i = 0; i < dest->getSize().y; ++i)
+    {
+        Vec4f* dst = destRows.getRow(i);
+
+        for (int j = 0; j < dest->getSize().x; ++j)
+            dst[j] = filterPixelJBF(m_context, j, i, m_kernel);
+
+        resolveRow(dst, dst, dest->getSize().x, m_resolveParams);
     }
 }
 
 void PathTraceRenderer::checkFinish()
 {
+    // Cancelled pass drained => swap in the context prepared meanwhile and start it.
+    if ( m_restartPending )
+    {
+        if ( m_launcher.getNumTasks() == m_launcher.getNumFinished() )
+        {
+            m_launcher.popAll();
+            m_restartPending = false;
+            m_context.swap(m_nextContext);
+            m_context.m_bForceExit = false;
+            launchPass();
+        }
+        return;
+    }
+
     // have all the vertices from current bounce finished computing?
     if ( m_launcher.getNumTasks() == m_launcher.getNumFinished() )
     {
         // yes, remove from task list
         m_launcher.popAll();
 
+        // Preview passes end by upsampling the pixels they skipped; the shaded ones stay put.
+        int scale = m_context.m_previewScale;
+        if (scale > 1 && !m_context.m_bForceExit)
+        {
+            Framebuffer<Vec4f>& image = *m_context.m_image;
+#pragma omp parallel for
+            for (int i = 0; i < image.getHeight(); ++i)
+                for (int j = 0; j < image.getWidth(); ++j)
+                    if (i % scale || j % scale)
+                        image(j, i) = upsamplePreview(m_context, image, j, i, scale);
+        }
+
         ++m_context.m_pass;
 
         // you may want to uncomment this to write out a sequence of PNG images
@@ -645,10 +940,6 @@ void PathTraceRenderer::checkFinish()
         //{
         //    // keep going
 
-        //    // If you change this, change the one in startPathTracingProcess too.
-        //    m_launcher.setNumThreads(m_launcher.getNumCores());
-        //    //m_launcher.setNumThreads(1);
-
         //    m_launcher.popAll();
         //    m_launcher.push( pathTraceBlock, &m_context, 0, (int)m_context.m_blocks.size() );
         //    //::printf( "Next pass!" );
@@ -659,18 +950,30 @@ void PathTraceRenderer::checkFinish()
 
 void PathTraceRenderer::stop() {
     m_context.m_bForceExit = true;
-    
-    if ( isRunning() )
+
+    // Tasks return within a sample; pop sleeps on the launcher's monitor until they do.
+    m_launcher.popAll();
+
+    m_restartPending = false;
+    m_backfilling = false;
+    m_context.m_bForceExit = false;
+}
+
+void PathTraceRenderer::restartPathTracingProcess( const MeshWithColors* scene, AreaLight* light, RayTracer* rt, Image* dest, int bounces, const CameraControls& camera )
+{
+    if ( !isRunning() || !m_context.m_image || m_context.m_image->getSize() != dest->getSize() )
     {
-        m_context.m_bForceExit = true;
-        while( m_launcher.getNumTasks() > m_launcher.getNumFinished() )
-        {
-            Sleep( 1 );
-        }
-        m_launcher.popAll();
+        stop();
+        startPathTracingProcess(scene, light, rt, dest, bounces, camera);
+        return;
     }
 
-    m_context.m_bForceExit = false;
+    // Backfill tasks are cancelled along with the pass. The next context is not used by any
+    // task, so it is cleared and blocked out while they return; checkFinish takes over from here.
+    m_context.m_bForceExit = true;
+    m_backfilling = false;
+    m_restartPending = true;
+    prepareContext(m_nextContext, scene, light, rt, dest, bounces, camera);
 }
 
 
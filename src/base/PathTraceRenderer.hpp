@@ -6,10 +6,15 @@
 #include "3d/Mesh.hpp"
 #include "base/Random.hpp"
 #include "base/MulticoreLauncher.hpp"
+#include "Framebuffer.hpp"
+#include "ColorTransform.hpp"
+#include "FrameCodec.hpp"
+#include "Foveation.hpp"
 
 #include <vector>
 #include <memory>
 #include <string>
+#include <atomic>
 
 namespace FW
 {
@@ -31,6 +36,8 @@ struct RaycastResult;
 struct RTTriangle;
 class Image;
 class AreaLight;
+class TextureCache;
+class ShadingFrames;
 
 
 /// Defines a block which is rendered by a single thread as a single task.
@@ -40,6 +47,9 @@ struct PathTracerBlock
     int m_y;      ///< Y coordinate of the topmost pixel of the block.
     int m_width;  ///< Pixel width of the block.
     int m_height; ///< Pixel height of the block.
+    int m_spp = 1;              ///< Samples per pixel, fewer away from the focus when foveated.
+    float m_priority = 1.0f;    ///< Blocks are dispatched highest priority first.
+    int m_node = 0;             ///< NUMA node whose workers render the block, see MulticoreLauncher::getNumNodes.
 };
 
 
@@ -47,23 +57,38 @@ struct PathTracerContext
 {
     PathTracerContext();
     ~PathTracerContext();
+
+    void                        swap(PathTracerContext& other);    ///< Everything but m_bForceExit.
     
     std::vector<PathTracerBlock> m_blocks; ///< Render blocks for rendering tasks. Index by .idx.
 
-    bool						m_bForceExit;
+    std::atomic<bool>			m_bForceExit;	///< Cancels the running pass; tasks check it before every sample.
 	bool						m_bResidual;
     const MeshWithColors*		m_scene;
     RayTracer*	                m_rt;
     AreaLight*                  m_light;
     int							m_pass;    ///< Pass number, increased by one for each full render iteration.
     int							m_bounces;
-    std::unique_ptr<Image>		m_image;
-    std::unique_ptr<Image>      m_normal;
-    std::unique_ptr<Image>      m_position;
+    int							m_previewScale;    ///< 2 or 4 for preview passes, which shade one pixel per scale x scale.
+    std::unique_ptr<Framebuffer<Vec4f>>	m_image;    ///< Accumulated radiance, w holds the sample weight.
+    std::unique_ptr<Framebuffer<Vec3f>>	m_normal;
+    std::unique_ptr<Framebuffer<Vec3f>>	m_position;
     Image*	                	m_destImage;
     const CameraControls*		m_camera;
 };
 
+/// Shadow connection from a path vertex to the light, with everything except the BRDF evaluated.
+struct LightConnection
+{
+    Vec3f   diffuse;
+    Vec3f   specular;
+    Vec3f   n;          ///< Shading normal, facing the viewer.
+    Vec3f   toLight;
+    Vec3f   toViewer;
+    float   glossiness;
+    Vec3f   weight;     ///< Throughput times emitted radiance, geometry term and inverse light pdf.
+};
+
 class PathVisualizationLine
 {
 public:
@@ -105,37 +130,84 @@ public:
     // negative #bounces = -N means start russian roulette from Nth bounce
     // positive N means always trace up to N bounces
     void				startPathTracingProcess				( const MeshWithColors* scene, AreaLight*, RayTracer* rt, Image* dest, int bounces, const CameraControls& camera );
+    // Same, but returns at once instead of waiting for a running pass to stop: the pass is
+    // cancelled, the new one is prepared in a second context right away, and checkFinish
+    // swaps it in and starts it when the last cancelled task has returned.
+    // Blocks like stop if the image size changes, since the old buffers must go.
+    void				restartPathTracingProcess			( const MeshWithColors* scene, AreaLight*, RayTracer* rt, Image* dest, int bounces, const CameraControls& camera );
+    bool				isRestartPending					( void ) const		{ return m_restartPending; }
+    // Stops and frees the pass buffers, so the next pass allocates them and has the workers
+    // touch them first again, e.g. after MulticoreLauncher::setPinThreads.
+    void				releaseBuffers						( void );
 	static Vec3f		tracePath(float x, float y, PathTracerContext& ctx, int samplerBase, Random& rnd, std::vector<PathVisualizationNode>& visualization, Vec3f& nn, Vec3f& pos, Mat4f& invP);
+	static bool			traceLightConnection(float x, float y, PathTracerContext& ctx, Random& rnd, Vec3f& nn, Vec3f& pos, const Mat4f& invP, LightConnection& c);
+	static Vec3f		traceIndirect(float x, float y, PathTracerContext& ctx, Random& rnd, const Mat4f& invP);
 	static void			pathTraceBlock(MulticoreLauncher::Task& t);
+	static void			backfillBlock(MulticoreLauncher::Task& t);
+	static void			clearBlock(MulticoreLauncher::Task& t);
 	static void			getTextureParameters(const RaycastResult& hit, Vec3f& diffuse, Vec3f& n, Vec3f& specular);
     void				updatePicture						( Image* display );	// normalize by 1/w
+    void				addIndirectTile(int vStart, const FrameTile& tile, const FrameDecoder& decoder, F32 replaceWeight);	// Server tile of the strip starting at row vStart; full frames count as replaceWeight samples.
+    void				addPreviewTile(int x0, int y0, int scale, const FrameTile& tile, const FrameDecoder& decoder, F32 replaceWeight);	// Reduced-resolution tile whose first value is pixel (x0, y0).
     void				blendFrame(Image* dest, int vStart, int vHeight);
+
+    // Local indirect light for row ranges (x = first row, y = end) the servers have not
+    // delivered. Each pass adds one sample per pixel, blended with the server samples by
+    // weight; passes only run once the direct light is done.
+    bool				startBackfill(const std::vector<Vec2i>& rowRanges);
+    bool				isBackfilling() const { return m_backfilling; }
+    bool				finishBackfill(int& rowStart, int& rowEnd);	// True once the running pass is done; returns its rows.
     void				denoise                             (Image* display);
     void				checkFinish							( void );
     void				stop								( void );
 	void				setNormalMapped						( bool b ){ m_normalMapped = b; }
+	static void			setTextureCache						( const TextureCache* cache ) { m_textureCache = cache; }
+	static void			setShadingFrames					( const ShadingFrames* frames ) { m_shadingFrames = frames; }
 
     static Vec3f evalMat(const Vec3f& diffuse, const Vec3f& specular, const Vec3f& n, const Vec3f& hit2Light, const Vec3f& Rd, float glossiness);
     void				setJBF(bool b) { m_JBF = b; }
     void				setKernel(int b) { m_kernel = b; }
     void				setSPP(int b) { m_spp = b; }
+    void				setFoveation(const WireFoveation& f) { m_foveation = f; }
+    void				setPreviewScale(int s) { m_previewScale = max(s, 1); }	// From the next pass on.
+    void				setExposure(float e) { m_resolveParams.exposure = e; }
+    void				setTonemap(Tonemap t) { m_resolveParams.tonemap = t; }
+    const ResolveParams&	getResolveParams() const { return m_resolveParams; }
+    void				resolve(Image* dest);	// Shows the current buffers again with new ResolveParams.
 
 protected:
+    void				prepareContext(PathTracerContext& ctx, const MeshWithColors* scene, AreaLight* light, RayTracer* rt, Image* dest, int bounces, const CameraControls& camera);
+    void				launchPass();	// Pushes the blocks of m_context.
+
     __int64						m_s64TotalRays;
     float						m_raysPerSecond;
 
     MulticoreLauncher			m_launcher;
 	static bool					m_normalMapped;
+	static const TextureCache*	m_textureCache;
+	static const ShadingFrames*	m_shadingFrames;
 
     static bool					m_JBF;
     static int                  m_kernel;
     static int                  m_spp;
 
-    static float                m_revPI;
+    ResolveParams               m_resolveParams;
+    WireFoveation               m_foveation = WireFoveation();
+    Framebuffer<Vec4f>          m_indirect;     ///< Indirect light from the servers, w holds the sample weight.
+    Framebuffer<Vec4f>          m_localIndirect;    ///< Indirect light from backfill passes, w holds the sample count.
+    Framebuffer<Vec4f>          m_backfillPass;     ///< Written by the running pass, added to m_localIndirect when it is done.
+    std::vector<PathTracerBlock> m_backfillBlocks;
+    bool                        m_hasIndirect = false;
+    U32                         m_indirectEpoch = 0;    ///< CameraControls epoch m_indirect and m_localIndirect hold light for.
+    bool                        m_backfilling = false;
+    int                         m_numBackfillPasses = 0;
+
+    PathTracerContext           m_nextContext;  ///< Prepared while a cancelled pass drains, then swapped with m_context.
+    bool                        m_restartPending = false;
+    int                         m_previewScale = 1;
 
 public:
     bool m_notDenoised = false;
-    std::vector<pColor> pixelColor;
 };
 
 }	// namespace FW
@@ -65,9 +65,14 @@ Mat3f formBasis(const Vec3f& n) {
 
 
 String RayTracer::computeMD5( const std::vector<Vec3f>& vertices )
+{
+    return computeMD5( &vertices[0], sizeof(Vec3f)*vertices.size() );
+}
+
+String RayTracer::computeMD5( const void* data, size_t size )
 {
     unsigned char digest[16];
-    MD5Buffer( (void*)&vertices[0], sizeof(Vec3f)*vertices.size(), (unsigned int*)digest );
+    MD5Buffer( (void*)data, size, (unsigned int*)digest );
 
     // turn into string
     char ad[33];
@@ -96,7 +101,12 @@ void RayTracer::loadHierarchy(const char* filename, std::vector<RTTriangle>& tri
     // YOUR CODE HERE (R1):
     // Integrate your implementation here.
     std::ifstream ifs(filename, std::ios::binary);
-    m_bvh = Bvh(ifs);
+    loadHierarchy(ifs, triangles);
+}
+
+void RayTracer::loadHierarchy(std::istream& is, std::vector<RTTriangle>& triangles)
+{
+    m_bvh = Bvh(is);
 
     m_triangles = &triangles;
     m_indices = &(m_bvh.getIndices());
@@ -106,7 +116,11 @@ void RayTracer::saveHierarchy(const char* filename, const std::vector<RTTriangle
     // YOUR CODE HERE (R1):
     // Integrate your implementation here.
     std::ofstream ofs(filename, std::ios::binary);
-    m_bvh.save(ofs);
+    saveHierarchy(ofs);
+}
+
+void RayTracer::saveHierarchy(std::ostream& os) {
+    m_bvh.save(os);
 }
 
 std::unique_ptr<BvhNode> RayTracer::constructBvhSahOptimalDim(size_t start, size_t end) {
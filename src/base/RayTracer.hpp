@@ -32,12 +32,15 @@ public:
 
     void				saveHierarchy			(const char* filename, const std::vector<RTTriangle>& triangles);
     void				loadHierarchy			(const char* filename, std::vector<RTTriangle>& triangles);
+    void				saveHierarchy			(std::ostream& os);
+    void				loadHierarchy			(std::istream& is, std::vector<RTTriangle>& triangles);
 
     RaycastResult		raycast					(const Vec3f& orig, const Vec3f& dir) const;
 
     // This function computes an MD5 checksum of the input scene data,
     // WITH the assumption that all vertices are allocated in one big chunk.
     static FW::String	computeMD5				(const std::vector<Vec3f>& vertices);
+    static FW::String	computeMD5				(const void* data, size_t size);
 
     std::vector<RTTriangle>* m_triangles;
 
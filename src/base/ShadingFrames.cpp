@@ -0,0 +1,40 @@
+#include "ShadingFrames.hpp"
+
+namespace FW {
+
+
+void ShadingFrames::build(const std::vector<RTTriangle>& triangles)
+{
+	m_triangles = triangles.empty() ? nullptr : &triangles[0];
+	m_frames.resize(triangles.size());
+
+#pragma omp parallel for
+	for (int i = 0; i < (int)triangles.size(); ++i)
+	{
+		const RTTriangle& tri = triangles[i];
+		Frame& frame = m_frames[i];
+
+		Vec3f deltaPos1 = tri.m_vertices[1].p - tri.m_vertices[0].p;
+		Vec3f deltaPos2 = tri.m_vertices[2].p - tri.m_vertices[0].p;
+
+		Vec2f deltaUV1 = tri.m_vertices[1].t - tri.m_vertices[0].t;
+		Vec2f deltaUV2 = tri.m_vertices[2].t - tri.m_vertices[0].t;
+
+		float det = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
+		if (det == 0.0f)
+		{
+			// No usable uv parameterization; shading falls back to the interpolated normal.
+			frame.tangent = Vec3f(0.0f);
+			frame.bitangent = Vec3f(0.0f);
+			continue;
+		}
+
+		// The 1/det scale only matters for its sign, normalization removes the rest.
+		float r = 1.0f / det;
+		frame.tangent = ((deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r).normalized();
+		frame.bitangent = ((deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r).normalized();
+	}
+}
+
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+
+#include "base/Math.hpp"
+#include "RTTriangle.hpp"
+
+#include <vector>
+
+
+namespace FW {
+
+
+// Per-triangle tangent and bitangent for normal mapping, kept parallel to the RTTriangle
+// array (which cannot grow new members) and built once by App::constructTracer.
+class ShadingFrames {
+public:
+	struct Frame {
+		Vec3f	tangent;	// Normalized dP/du, zero if the triangle's uv mapping is degenerate.
+		Vec3f	bitangent;	// Normalized dP/dv.
+	};
+
+	void				build			(const std::vector<RTTriangle>& triangles);
+	void				clear			(void)						{ m_frames.clear(); m_triangles = nullptr; }
+
+	const Frame&		getFrame		(const RTTriangle* tri) const {
+		FW_ASSERT(tri >= m_triangles && tri < m_triangles + m_frames.size());
+		return m_frames[tri - m_triangles];
+	}
+
+	// Transforms a tangent-space normal to world space around the interpolated normal n.
+	static Vec3f		toWorld			(const Frame& frame, const Vec3f& n, const Vec3f& tangentNormal) {
+		return (frame.tangent * tangentNormal.x + frame.bitangent * tangentNormal.y + n * tangentNormal.z).normalized();
+	}
+
+private:
+	std::vector<Frame>	m_frames;
+	const RTTriangle*	m_triangles = nullptr;
+};
+
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+
+#include "base/Defs.hpp"
+
+#include <atomic>
+#include <vector>
+
+
+namespace FW {
+
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Each index is written by one side only; the release store publishing it pairs with
+// the other side's acquire load, so an element is fully constructed before it is seen.
+template <class T>
+class SpscQueue {
+public:
+	explicit SpscQueue(int capacity = 256)
+		: m_slots(roundUpPow2(capacity + 1)), m_mask((U32)m_slots.size() - 1), m_head(0), m_tail(0) {}
+
+	// Producer side. Returns false and leaves value untouched if the queue is full.
+	bool				push		(T&& value) {
+		U32 tail = m_tail.load(std::memory_order_relaxed);
+		U32 next = (tail + 1) & m_mask;
+		if (next == m_head.load(std::memory_order_acquire))
+			return false;
+		m_slots[tail] = std::move(value);
+		m_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns false if the queue is empty.
+	bool				pop			(T& value) {
+		U32 head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+			return false;
+		value = std::move(m_slots[head]);
+		m_head.store((head + 1) & m_mask, std::memory_order_release);
+		return true;
+	}
+
+	bool				isEmpty		(void) const				{ return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+
+private:
+	static size_t		roundUpPow2	(int n)						{ size_t s = 2; while (s < (size_t)n) s <<= 1; return s; }
+
+						SpscQueue	(const SpscQueue&); // forbidden
+	SpscQueue&			operator=	(const SpscQueue&); // forbidden
+
+	std::vector<T>		m_slots;
+	U32					m_mask;
+
+	// Kept on separate cache lines so the two threads do not false-share.
+	alignas(64) std::atomic<U32> m_head;	// Next slot to pop, written by the consumer.
+	alignas(64) std::atomic<U32> m_tail;	// Next slot to push, written by the producer.
+};
+
+
+}
@@ -0,0 +1,151 @@
+#include "TextureCache.hpp"
+#include "ColorTransform.hpp"
+
+#include <algorithm>
+
+namespace FW {
+
+
+static inline U16 toUnorm16(F32 v)
+{
+	return (U16)(FW::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+void CachedTexture::build(const Image& image, bool linearize)
+{
+	m_levels.clear();
+
+	Level base;
+	base.size = image.getSize();
+	base.texels.resize((size_t)base.size.x * base.size.y * 4);
+
+#pragma omp parallel for
+	for (int y = 0; y < base.size.y; ++y)
+	{
+		U16* row = &base.texels[(size_t)y * base.size.x * 4];
+		for (int x = 0; x < base.size.x; ++x)
+		{
+			Vec4f c = image.getVec4f(Vec2i(x, y));
+			if (linearize)
+				c = Vec4f(fetchLinearTexel(image, Vec2i(x, y)), c.w);
+
+			for (int k = 0; k < 4; ++k)
+				row[x * 4 + k] = toUnorm16(c[k]);
+		}
+	}
+	m_levels.push_back(std::move(base));
+
+	// Box-filter down to 1x1. Filtering happens in linear space, unlike Image::downscale2x.
+	while (m_levels.back().size.x > 1 || m_levels.back().size.y > 1)
+	{
+		const Level& src = m_levels.back();
+		Level dst;
+		dst.size = Vec2i(max(src.size.x >> 1, 1), max(src.size.y >> 1, 1));
+		dst.texels.resize((size_t)dst.size.x * dst.size.y * 4);
+
+		for (int y = 0; y < dst.size.y; ++y)
+		for (int x = 0; x < dst.size.x; ++x)
+		{
+			int x0 = min(x * 2, src.size.x - 1), x1 = min(x * 2 + 1, src.size.x - 1);
+			int y0 = min(y * 2, src.size.y - 1), y1 = min(y * 2 + 1, src.size.y - 1);
+			for (int k = 0; k < 4; ++k)
+			{
+				U32 sum = src.texels[((size_t)y0 * src.size.x + x0) * 4 + k] + src.texels[((size_t)y0 * src.size.x + x1) * 4 + k]
+						+ src.texels[((size_t)y1 * src.size.x + x0) * 4 + k] + src.texels[((size_t)y1 * src.size.x + x1) * 4 + k];
+				dst.texels[((size_t)y * dst.size.x + x) * 4 + k] = (U16)((sum + 2) >> 2);
+			}
+		}
+		m_levels.push_back(std::move(dst));
+	}
+}
+
+F32 CachedTexture::getLod(F32 uvArea) const
+{
+	Vec2i size = getSize();
+	F32 texels = uvArea * (F32)size.x * (F32)size.y;
+	if (!(texels > 1.0f))
+		return 0.0f;
+	return 0.5f * log2(texels);
+}
+
+Vec4f CachedTexture::fetch(const Level& level, int x, int y) const
+{
+	const U16* t = &level.texels[((size_t)y * level.size.x + x) * 4];
+	return Vec4f(t[0], t[1], t[2], t[3]) * (1.0f / 65535.0f);
+}
+
+Vec4f CachedTexture::sample(const Vec2f& uv, F32 lod) const
+{
+	const Level& level = m_levels[min((int)(lod + 0.5f), getNumLevels() - 1)];
+
+	float u = uv.x - floor(uv.x);
+	float v = uv.y - floor(uv.y);
+
+	float fx = u * level.size.x - 0.5f;
+	float fy = v * level.size.y - 0.5f;
+	int x0 = (int)floor(fx);
+	int y0 = (int)floor(fy);
+	float tx = fx - x0;
+	float ty = fy - y0;
+
+	int x1 = x0 + 1 >= level.size.x ? 0 : x0 + 1;
+	int y1 = y0 + 1 >= level.size.y ? 0 : y0 + 1;
+	if (x0 < 0) x0 = level.size.x - 1;
+	if (y0 < 0) y0 = level.size.y - 1;
+
+	Vec4f top = lerp(fetch(level, x0, y0), fetch(level, x1, y0), tx);
+	Vec4f bottom = lerp(fetch(level, x0, y1), fetch(level, x1, y1), tx);
+	return lerp(top, bottom, ty);
+}
+
+//------------------------------------------------------------------------
+
+const CachedTexture* TextureCache::getTexture(const Texture& texture, bool linearize)
+{
+	if (!texture.exists())
+		return nullptr;
+
+	std::unique_ptr<CachedTexture>& cached = m_textures[std::make_pair(texture.getImage(), linearize)];
+	if (!cached)
+	{
+		cached.reset(new CachedTexture);
+		cached->build(*texture.getImage(), linearize);
+	}
+	return cached.get();
+}
+
+void TextureCache::build(const MeshBase& mesh, const std::vector<RTTriangle>& triangles)
+{
+	clear();
+
+	FW_ASSERT(mesh.numSubmeshes() <= 0xFFFF);
+	std::map<const MeshBase::Material*, U16> materialIndex;
+
+	for (int i = 0; i < mesh.numSubmeshes(); ++i)
+	{
+		const MeshBase::Material& mat = mesh.material(i);
+		MaterialTextures entry;
+		entry.diffuse = getTexture(mat.textures[MeshBase::TextureType_Diffuse], true);
+		entry.normal = getTexture(mat.textures[MeshBase::TextureType_Normal], false);
+		entry.specular = getTexture(mat.textures[MeshBase::TextureType_Specular], false);
+
+		materialIndex[&mat] = (U16)m_materials.size();
+		m_materials.push_back(entry);
+	}
+
+	m_triangles = triangles.empty() ? nullptr : &triangles[0];
+	m_triangleMaterial.resize(triangles.size());
+	for (size_t i = 0; i < triangles.size(); ++i)
+		m_triangleMaterial[i] = materialIndex[triangles[i].m_material];
+}
+
+void TextureCache::clear()
+{
+	m_textures.clear();
+	m_materials.clear();
+	m_triangleMaterial.clear();
+	m_triangles = nullptr;
+}
+
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+
+#include "3d/Mesh.hpp"
+#include "RTTriangle.hpp"
+
+#include <vector>
+#include <map>
+#include <memory>
+
+
+namespace FW {
+
+
+// Render-side copy of a material texture: converted once at load time to linear
+// 16-bit unorm RGBA and box-filtered into a full mip chain, so shading never touches
+// Image format dispatch or gamma decoding. All textures in the scenes are LDR, so
+// unorm16 keeps more precision than half floats at the same 8 bytes per texel.
+class CachedTexture {
+public:
+	void				build			(const Image& image, bool linearize);
+
+	Vec2i				getSize			(void) const				{ return m_levels.empty() ? Vec2i(0) : m_levels[0].size; }
+	int					getNumLevels	(void) const				{ return (int)m_levels.size(); }
+
+	// Mip level whose texels best match a footprint covering uvArea of the [0,1]^2 uv square.
+	F32					getLod			(F32 uvArea) const;
+
+	// Bilinear fetch from the nearest mip level, with wrapping addressing.
+	Vec4f				sample			(const Vec2f& uv, F32 lod) const;
+
+private:
+	struct Level {
+		Vec2i			size;
+		std::vector<U16> texels;	// 4 channels per texel, row-major.
+	};
+
+	Vec4f				fetch			(const Level& level, int x, int y) const;
+
+	std::vector<Level>	m_levels;
+};
+
+
+// Per-material texture set plus a per-triangle material index, built by App::constructTracer
+// alongside the RTTriangle array. Textures shared between materials are converted only once.
+class TextureCache {
+public:
+	struct MaterialTextures {
+		const CachedTexture*	diffuse;	// Linearized.
+		const CachedTexture*	normal;		// Raw [0,1] encoded normals.
+		const CachedTexture*	specular;	// Raw.
+	};
+
+	void				build			(const MeshBase& mesh, const std::vector<RTTriangle>& triangles);
+	void				clear			(void);
+
+	const MaterialTextures& getMaterial	(const RTTriangle* tri) const {
+		FW_ASSERT(tri >= m_triangles && tri < m_triangles + m_triangleMaterial.size());
+		return m_materials[m_triangleMaterial[tri - m_triangles]];
+	}
+
+private:
+	const CachedTexture* getTexture		(const Texture& texture, bool linearize);
+
+	std::map<std::pair<const Image*, bool>, std::unique_ptr<CachedTexture>> m_textures;
+	std::vector<MaterialTextures>	m_materials;			// One per submesh.
+	std::vector<U16>				m_triangleMaterial;		// Index into m_materials, parallel to the triangle array.
+	const RTTriangle*				m_triangles = nullptr;
+};
+
+
+}
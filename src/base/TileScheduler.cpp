@@ -0,0 +1,100 @@
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+
+namespace FW {
+
+
+TileScheduler::TileScheduler(void)
+{
+}
+
+void TileScheduler::reset(const Vec2i& imageSize, const WireFoveation& foveation, int tileSize)
+{
+	m_tiles.clear();
+	m_order.clear();
+	m_queue.clear();
+	m_inFlight.clear();
+
+	for (int y = 0; y < imageSize.y; y += tileSize)
+	for (int x = 0; x < imageSize.x; x += tileSize)
+	{
+		Tile tile;
+		tile.id = (S32)m_tiles.size();
+		tile.x = x;
+		tile.y = y;
+		tile.width = min(tileSize, imageSize.x - x);
+		tile.height = min(tileSize, imageSize.y - y);
+		m_tiles.push_back(tile);
+		m_order.push_back(tile.id);
+	}
+
+	std::vector<F32> priority(m_tiles.size());
+	for (const Tile& t : m_tiles)
+		priority[t.id] = getFoveaPriority(foveation, imageSize, t.x, t.y, t.width, t.height);
+	std::stable_sort(m_order.begin(), m_order.end(), [&](int a, int b) { return priority[a] > priority[b]; });
+	m_queue.assign(m_order.begin(), m_order.end());
+}
+
+bool TileScheduler::acquire(const std::string& server, Tile& tile)
+{
+	if (m_queue.empty())
+	{
+		// Everything has been issued: start another pass over the tiles not in flight.
+		for (int id : m_order)
+			if (m_inFlight.find(id) == m_inFlight.end())
+				m_queue.push_back(id);
+		if (m_queue.empty())
+			return false;
+	}
+
+	int id = m_queue.front();
+	m_queue.pop_front();
+
+	InFlight& f = m_inFlight[id];
+	f.server = server;
+	f.issued = Clock::now();
+	tile = m_tiles[id];
+	return true;
+}
+
+void TileScheduler::complete(int tileId, const std::string& server)
+{
+	// A late result from a server that timed out must not clear the reissued copy.
+	auto it = m_inFlight.find(tileId);
+	if (it != m_inFlight.end() && it->second.server == server)
+		m_inFlight.erase(it);
+}
+
+void TileScheduler::releaseServer(const std::string& server)
+{
+	for (auto it = m_inFlight.begin(); it != m_inFlight.end();)
+	{
+		if (it->second.server == server)
+		{
+			m_queue.push_front(it->first);
+			it = m_inFlight.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+void TileScheduler::checkTimeouts(F32 timeoutSeconds)
+{
+	Clock::time_point now = Clock::now();
+	for (auto it = m_inFlight.begin(); it != m_inFlight.end();)
+	{
+		// Overdue tiles go to the front of the queue; a late result still adds its samples.
+		if (std::chrono::duration<F32>(now - it->second.issued).count() > timeoutSeconds)
+		{
+			m_queue.push_front(it->first);
+			it = m_inFlight.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+
+}
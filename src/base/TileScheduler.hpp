@@ -0,0 +1,63 @@
+#pragma once
+
+
+#include "base/Math.hpp"
+#include "Foveation.hpp"
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace FW {
+
+
+// Client-side queue of image tiles for pull-mode rendering. A server asks for work with a
+// WireMessage_TileRequest on the control socket and renders each WireTileAssignment it gets
+// back; the finished tile returns on the frame socket with FrameHeader::tileId naming it.
+// Requests for an older epoch are ignored, the server asks again once it has caught up.
+//
+// Tiles are tracked while in flight and handed out again if the server misses the timeout
+// or disappears. When every tile has been issued the next pass starts, so servers keep
+// refining the image for as long as the view stays put. Every pass hands tiles out in order
+// of their foveation priority.
+class TileScheduler {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Tile {
+		S32		id;
+		S32		x, y;
+		S32		width, height;
+	};
+
+						TileScheduler		(void);
+
+	// Starts over for a new epoch or image size; work in flight is forgotten.
+	void				reset				(const Vec2i& imageSize, const WireFoveation& foveation, int tileSize = 64);
+
+	bool				acquire				(const std::string& server, Tile& tile);
+	void				complete			(int tileId, const std::string& server);
+	void				releaseServer		(const std::string& server);	// Requeues everything the server holds.
+	void				checkTimeouts		(F32 timeoutSeconds);
+
+	bool				isValidTile			(int tileId) const			{ return tileId >= 0 && tileId < (int)m_tiles.size(); }
+	const Tile&			getTile				(int tileId) const			{ return m_tiles[tileId]; }
+	int					getNumInFlight		(void) const				{ return (int)m_inFlight.size(); }
+
+private:
+	struct InFlight {
+		std::string			server;
+		Clock::time_point	issued;
+	};
+
+	std::vector<Tile>			m_tiles;	// By tile id.
+	std::vector<int>			m_order;	// Tile ids, highest priority first.
+	std::deque<int>				m_queue;
+	std::map<int, InFlight>		m_inFlight;	// By tile id.
+};
+
+
+}
@@ -33,12 +33,6 @@
 
 using namespace FW;
 
-struct CameraControl {
-    Vec3f rotate;
-    Vec3f move;
-    F32 fov;
-};
-
 //------------------------------------------------------------------------
 
 static const F32 s_mouseRotateSpeed = 0.005f;
@@ -58,12 +52,22 @@ CameraControls::CameraControls(CommonControls* commonControls, U32 features)
     m_dragMiddle        (false),
     m_dragRight         (false),
     m_alignY            (false),
-    m_alignZ            (false)
+    m_alignZ            (false),
+    m_syncTimer         (true),
+    m_syncRate          (120.0f),
+    m_sequence          (0),
+    m_statePending      (false),
+    m_epoch             (0)
 {
     initDefaults();
     if ((m_features & Feature_StereoControls) != 0 && !GLContext::isStereoAvailable())
         m_features &= ~Feature_StereoControls;
 
+    m_sentPosition = m_position;
+    m_sentForward = m_forward;
+    m_sentUp = m_up;
+    m_sentFov = m_fov;
+
     // set up input publish socket
     m_context = zmq::context_t(1);
     m_inputPubSocket = zmq::socket_t(m_context, zmq::socket_type::pub);
@@ -258,16 +262,6 @@ bool CameraControls::handleEvent(const Window::Event& ev)
     //    }
     //}
 
-    if (hasMovement || m_oldFov != m_fov) {
-        // send client 
-        m_oldFov = m_fov;
-        CameraControl ctl = { rotate, move, m_fov };
-        zmq::message_t message(sizeof(CameraControl));
-        std::memcpy(message.data(), &ctl, sizeof(CameraControl));
-        m_inputPubSocket.send(message, zmq::send_flags::none);
-        // std::cout << "input sent!" << std::endl;
-    }
-
     // Apply movement.
 
     if (m_enableMovement)
@@ -302,6 +296,12 @@ bool CameraControls::handleEvent(const Window::Event& ev)
         m_up = Vec3f(0.0f, 0.0f, 1.0f);
     m_alignZ = false;
 
+    // Send the new camera state to servers once the sync interval is up.
+
+    m_frame.clear();
+    if (writeSnapshot(m_frame, false))
+        send(m_frame);
+
     // Update stereo mode.
 
     if (hasFeature(Feature_StereoControls))
@@ -318,10 +318,63 @@ bool CameraControls::handleEvent(const Window::Event& ev)
     return false;
 }
 
-void CameraControls::sendControl(const void* src, size_t size) 
+void CameraControls::sendControl(const WireWriter& messages)
+{
+    // A pending camera snapshot goes first in the same frame, so servers see changes in
+    // the order they were made.
+    m_frame.clear();
+    writeSnapshot(m_frame, true);
+    m_frame.append(messages);
+    ++m_epoch;
+    send(m_frame);
+}
+
+//------------------------------------------------------------------------
+
+U32 CameraControls::advanceEpoch(void)
+{
+    // The caller's message must not overtake a camera change made before it.
+    m_frame.clear();
+    if (writeSnapshot(m_frame, true))
+        send(m_frame);
+    return ++m_epoch;
+}
+
+//------------------------------------------------------------------------
+
+bool CameraControls::writeSnapshot(WireWriter& frame, bool force)
+{
+    bool changed = m_position != m_sentPosition || m_forward != m_sentForward || m_up != m_sentUp || m_fov != m_sentFov;
+
+    // Frames rendered for the old view are stale as soon as the camera moves, even while
+    // the snapshot waits for the next tick.
+    if (changed && !m_statePending)
+    {
+        ++m_epoch;
+        m_statePending = true;
+    }
+
+    if (!m_statePending || (!force && m_syncTimer.getElapsed() < 1.0f / m_syncRate))
+        return false;
+
+    WireCameraState state = { ++m_sequence, m_position, m_forward, m_up, m_fov };
+    writeWire(frame, state);
+
+    m_sentPosition = m_position;
+    m_sentForward = m_forward;
+    m_sentUp = m_up;
+    m_sentFov = m_fov;
+    m_statePending = false;
+    m_syncTimer.start();
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+void CameraControls::send(WireWriter& frame)
 {
-    zmq::message_t message(size);
-    std::memcpy(message.data(), src, size);
+    const Array<U8>& data = frame.finish(m_epoch);
+    zmq::message_t message(data.getPtr(), data.getSize());
     m_inputPubSocket.send(message, zmq::send_flags::none);
 }
 
@@ -531,6 +584,7 @@ void CameraControls::addGUIControls(void)
     cc.beginSliderStack();
     if (hasFeature(Feature_FOVSlider))
         cc.addSlider(&m_fov, 1.0f, 179.0f, false, FW_KEY_NONE, FW_KEY_NONE, "Camera FOV = %.1f degrees", 0.2f);
+    cc.addSlider(&m_syncRate, 10.0f, 240.0f, false, FW_KEY_NONE, FW_KEY_NONE, "Camera sync rate = %.0f Hz", 0.2f);
     //if (hasFeature(Feature_NearSlider))
     //    cc.addSlider(&m_near, 1.0e-3f, 1.0e2f, true, FW_KEY_NONE, FW_KEY_NONE, "Camera near = %g units", 0.05f);
     //if (hasFeature(Feature_FarSlider))
@@ -555,6 +609,7 @@ void CameraControls::removeGUIControls(void)
     cc.removeControl(&m_keepAligned);
     cc.removeControl(&m_speed);
     cc.removeControl(&m_fov);
+    cc.removeControl(&m_syncRate);
     cc.removeControl(&m_near);
     cc.removeControl(&m_far);
     cc.removeControl(&m_enableStereo);
@@ -28,6 +28,7 @@
 #pragma once
 #include "gui/CommonControls.hpp"
 #include "base/Timer.hpp"
+#include "io/WireProtocol.hpp"
 #include <zmq.hpp>
 #include <zmq_addon.hpp>
 
@@ -154,8 +155,6 @@ private:
     F32                 m_stereoSeparation;
     F32                 m_stereoConvergence;
 
-    F32                 m_oldFov;
-
 public:
     zmq::context_t m_context;
     zmq::socket_t m_inputPubSocket;
@@ -165,7 +164,35 @@ public:
     //zmq::message_t socketEvent;
 
 public:
-    void sendControl(const void* src, size_t size);
+    // Every message on the input socket is one WireProtocol frame, whose header carries the
+    // epoch it starts. Servers tag their frames with the epoch they last applied, which
+    // lets the client drop frames rendered for an outdated view.
+    //
+    // Camera movement is coalesced: handleEvent publishes at most one absolute camera
+    // snapshot per 1 / syncRate seconds, so bursts of mouse events cost servers one restart.
+    // sendControl publishes all of the given messages in a single frame.
+    void sendControl(const WireWriter& messages);
+    U32  getEpoch(void) const { return m_epoch; }
+    U32  advanceEpoch(void); // for state sent outside the input socket; the caller delivers the epoch
+    F32  getSyncRate(void) const { return m_syncRate; }
+    void setSyncRate(F32 hz) { m_syncRate = hz; }
+
+private:
+    bool writeSnapshot(WireWriter& frame, bool force);
+    void send(WireWriter& frame);
+
+    WireWriter          m_frame;            // Reused for every frame published.
+
+    Timer               m_syncTimer;
+    F32                 m_syncRate;         // Camera snapshots per second, at most.
+    U32                 m_sequence;
+    bool                m_statePending;     // Camera changed since the last snapshot.
+    Vec3f               m_sentPosition;
+    Vec3f               m_sentForward;
+    Vec3f               m_sentUp;
+    F32                 m_sentFov;
+
+    U32                 m_epoch;
 };
 
 //------------------------------------------------------------------------
@@ -1105,7 +1105,7 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 
 /*inflate a block with dynamic of fixed Huffman tree*/
 static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size_t* bp,
-                                    size_t* pos, size_t inlength, unsigned btype)
+                                    size_t* pos, size_t inlength, unsigned btype, size_t maxoutsize)
 {
   unsigned error = 0;
   HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
@@ -1129,8 +1129,11 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
     {
       if((*pos) >= out->size)
       {
-        /*reserve more room at once*/
-        if(!ucvector_resize(out, ((*pos) + 1) * 2)) ERROR_BREAK(9913 /*alloc fail*/);
+        /*reserve more room at once, but never more than the limit*/
+        size_t newsize = ((*pos) + 1) * 2;
+        if(maxoutsize && (*pos) + 1 > maxoutsize) ERROR_BREAK(81 /*output too large*/);
+        if(maxoutsize && newsize > maxoutsize) newsize = maxoutsize;
+        if(!ucvector_resize(out, newsize)) ERROR_BREAK(9913 /*alloc fail*/);
       }
       out->data[(*pos)] = (unsigned char)(code_ll);
       (*pos)++;
@@ -1175,8 +1178,11 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
       backward = start - distance;
       if((*pos) + length >= out->size)
       {
-        /*reserve more room at once*/
-        if(!ucvector_resize(out, ((*pos) + length) * 2)) ERROR_BREAK(9914 /*alloc fail*/);
+        /*reserve more room at once, but never more than the limit*/
+        size_t newsize = ((*pos) + length) * 2;
+        if(maxoutsize && (*pos) + length > maxoutsize) ERROR_BREAK(81 /*output too large*/);
+        if(maxoutsize && newsize > maxoutsize) newsize = maxoutsize;
+        if(!ucvector_resize(out, newsize)) ERROR_BREAK(9914 /*alloc fail*/);
       }
 
       for(forward = 0; forward < length; forward++)
@@ -1206,7 +1212,8 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   return error;
 }
 
-static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength)
+static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength,
+                                     size_t maxoutsize)
 {
   /*go to first boundary of byte*/
   size_t p;
@@ -1222,6 +1229,7 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
   /*check if 16-bit NLEN is really the one's complement of LEN*/
   if(LEN + NLEN != 65535) return 21; /*error: NLEN is not one's complement of LEN*/
 
+  if(maxoutsize && (*pos) + LEN > maxoutsize) return 81; /*output too large*/
   if((*pos) + LEN >= out->size)
   {
     if(!ucvector_resize(out, (*pos) + LEN)) return 9915; /*alloc fail*/
@@ -1236,8 +1244,9 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
   return error;
 }
 
-/*inflate the deflated data (cfr. deflate spec); return value is the error*/
-static unsigned LodePNG_inflate(ucvector* out, const unsigned char* in, size_t insize, size_t inpos)
+/*inflate the deflated data (cfr. deflate spec); return value is the error.
+maxoutsize limits the size of out, 0 means no limit*/
+static unsigned LodePNG_inflate(ucvector* out, const unsigned char* in, size_t insize, size_t inpos, size_t maxoutsize)
 {
   /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
   size_t bp = 0;
@@ -1255,8 +1264,8 @@ static unsigned LodePNG_inflate(ucvector* out, const unsigned char* in, size_t i
     BTYPE += 2 * readBitFromStream(&bp, &in[inpos]);
 
     if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
-    else if(BTYPE == 0) error = inflateNoCompression(out, &in[inpos], &bp, &pos, insize); /*no compression*/
-    else error = inflateHuffmanBlock(out, &in[inpos], &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
+    else if(BTYPE == 0) error = inflateNoCompression(out, &in[inpos], &bp, &pos, insize, maxoutsize); /*no compression*/
+    else error = inflateHuffmanBlock(out, &in[inpos], &bp, &pos, insize, BTYPE, maxoutsize); /*compression, BTYPE 01 or 10*/
 
     if(error) return error;
   }
@@ -2064,7 +2073,7 @@ unsigned LodePNG_zlib_decompress(unsigned char** out, size_t* outsize, const uns
 
   /*ucvector-controlled version of the output buffer, for dynamic array*/
   ucvector_init_buffer(&outv, *out, *outsize);
-  error = LodePNG_inflate(&outv, in, insize, 2);
+  error = LodePNG_inflate(&outv, in, insize, 2, settings->maxOutputSize);
   *out = outv.data;
   *outsize = outv.size;
   if(error) return error;
@@ -2179,9 +2188,10 @@ const LodePNG_CompressSettings LodePNG_defaultCompressSettings = {2, 1, DEFAULT_
 void LodePNG_DecompressSettings_init(LodePNG_DecompressSettings* settings)
 {
   settings->ignoreAdler32 = 0;
+  settings->maxOutputSize = 0;
 }
 
-const LodePNG_DecompressSettings LodePNG_defaultDecompressSettings = {0};
+const LodePNG_DecompressSettings LodePNG_defaultDecompressSettings = {0, 0};
 
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -5327,6 +5337,7 @@ const char* LodePNG_error_text(unsigned code)
     case 78: return "failed to open file for reading"; /*file doesn't exist or couldn't be opened for reading*/
     case 79: return "failed to open file for writing";
     case 80: return "tried creating a tree of 0 symbols";
+    case 81: return "inflated data larger than maxOutputSize";
     default: ; /*nothing to do here, checks for other error values are below*/
   }
 
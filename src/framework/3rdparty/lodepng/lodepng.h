@@ -297,6 +297,7 @@ PNG files. Typically you won't need these directly.
 typedef struct LodePNG_DecompressSettings
 {
   unsigned ignoreAdler32; /*if 1, continue and don't give an error message if the Adler32 checksum is corrupted*/
+  size_t maxOutputSize; /*if not 0, give error 81 as soon as the inflated data would grow larger than this*/
 } LodePNG_DecompressSettings;
 
 extern const LodePNG_DecompressSettings LodePNG_defaultDecompressSettings;
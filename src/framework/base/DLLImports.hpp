@@ -42,7 +42,7 @@
 #   pragma warning(pop)
 #endif
 
-#if (!FW_CUDA)
+#if (!FW_CUDA && !FW_HEADLESS)
 #   define _WIN32_WINNT 0x0600
 #   define WIN32_LEAN_AND_MEAN
 #   define _KERNEL32_
@@ -63,7 +63,7 @@
 
 namespace FW
 {
-#if (!FW_CUDA)
+#if (!FW_CUDA && !FW_HEADLESS)
 void    setCudaDLLName      (const String& name);
 void    initDLLImports      (void);
 void    initGLImports       (void);
@@ -128,7 +128,7 @@ typedef size_t          CUsize_t;
 // GL definitions.
 //------------------------------------------------------------------------
 
-#if (!FW_CUDA && FW_USE_GLEW)
+#if (!FW_CUDA && !FW_HEADLESS && FW_USE_GLEW)
 #   define GL_FUNC_AVAILABLE(NAME) (NAME != NULL)
 #   define GLEW_STATIC
 #   include "3rdparty/glew/include/GL/glew.h"
@@ -137,7 +137,7 @@ typedef size_t          CUsize_t;
 #       include <cudaGL.h>
 #   endif
 
-#elif (!FW_CUDA && !FW_USE_GLEW)
+#elif (!FW_CUDA && !FW_HEADLESS && !FW_USE_GLEW)
 #   define GL_FUNC_AVAILABLE(NAME) (isAvailable_ ## NAME())
 #   include <GL/gl.h>
 #   if FW_USE_CUDA
@@ -369,7 +369,7 @@ typedef unsigned int    GLhandleARB;
 
 //------------------------------------------------------------------------
 
-#if (!FW_CUDA)
+#if (!FW_CUDA && !FW_HEADLESS)
 #   define FW_DLL_IMPORT_RETV(RET, CALL, NAME, PARAMS, PASS)        bool isAvailable_ ## NAME(void);
 #   define FW_DLL_IMPORT_VOID(RET, CALL, NAME, PARAMS, PASS)        bool isAvailable_ ## NAME(void);
 #   define FW_DLL_DECLARE_RETV(RET, CALL, NAME, PARAMS, PASS)       bool isAvailable_ ## NAME(void); RET CALL NAME PARAMS;
@@ -27,7 +27,9 @@
 
 #pragma once
 
-#pragma warning(disable:4530) // C++ exception handler used, but unwind semantics are not enabled.
+#ifdef _MSC_VER
+#   pragma warning(disable:4530) // C++ exception handler used, but unwind semantics are not enabled.
+#endif
 #include <new>
 #include <string.h>
 
@@ -45,7 +47,7 @@ namespace FW
 #   define FW_DEBUG 0
 #endif
 
-#ifdef _M_X64
+#if defined(_M_X64) || defined(__LP64__)
 #   define FW_64    1
 #else
 #   define FW_64    0
@@ -57,6 +59,13 @@ namespace FW
 #   define FW_CUDA 0
 #endif
 
+// Console tools that only use the containers, math and streams can be built without
+// Win32, GL and CUDA, on other platforms too. They link src/standin/HeadlessDefs.cpp
+// instead of Defs.cpp.
+#ifndef FW_HEADLESS
+#   define FW_HEADLESS 0
+#endif
+
 #if FW_CUDA && !defined(__CUDA_ARCH__)
 #   define __CUDA_ARCH__ 100 // e.g. 120 = compute capability 1.2
 #endif
@@ -90,7 +99,7 @@ typedef float               F32;
 typedef double              F64;
 typedef void                (*FuncPtr)(void);
 
-#if FW_CUDA
+#if FW_CUDA || !defined(_MSC_VER)
 typedef unsigned long long  U64;
 typedef signed long long    S64;
 #else
@@ -101,9 +110,12 @@ typedef signed __int64      S64;
 #if FW_64
 typedef S64                 SPTR;
 typedef U64                 UPTR;
-#else
+#elif defined(_MSC_VER)
 typedef __w64 S32           SPTR;
 typedef __w64 U32           UPTR;
+#else
+typedef S32                 SPTR;
+typedef U32                 UPTR;
 #endif
 
 //------------------------------------------------------------------------
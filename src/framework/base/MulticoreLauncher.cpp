@@ -30,6 +30,141 @@
 
 using namespace FW;
 
+//------------------------------------------------------------------------
+// Chase-Lev work-stealing deque, with the memory orderings of Le et al.,
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (2013).
+// The owning worker pushes and pops at the bottom without locking, other
+// workers steal from the top with a CAS. A thief may read a slot that is
+// being overwritten, but then its CAS fails and the copy is discarded.
+// Rings only grow; old ones are kept until the deque dies, since a thief
+// may still be reading from one.
+//------------------------------------------------------------------------
+
+namespace FW
+{
+
+struct WorkRing
+{
+    S64                         mask;
+    MulticoreLauncher::Task*    slots;
+
+    explicit                    WorkRing    (S64 size)  : mask(size - 1), slots(new MulticoreLauncher::Task[(size_t)size]) {}
+                                ~WorkRing   (void)      { delete[] slots; }
+    MulticoreLauncher::Task&    operator[]  (S64 i)     { return slots[i & mask]; }
+};
+
+class WorkDeque
+{
+public:
+    typedef MulticoreLauncher::Task Task;
+
+                            WorkDeque           (void)  : m_top(0), m_bottom(0), m_ring(new WorkRing(256)) {}
+                            ~WorkDeque          (void);
+
+    void                    push                (const Task& task); // Owner only.
+    bool                    pop                 (Task& task);       // Owner only.
+    bool                    steal               (Task& task);       // May fail spuriously under contention.
+
+private:
+                            WorkDeque           (const WorkDeque&); // forbidden
+    WorkDeque&              operator=           (const WorkDeque&); // forbidden
+
+private:
+    std::atomic<S64>        m_top;
+    std::atomic<S64>        m_bottom;
+    std::atomic<WorkRing*>  m_ring;
+    Array<WorkRing*>        m_retired;
+};
+
+}
+
+//------------------------------------------------------------------------
+
+WorkDeque::~WorkDeque(void)
+{
+    delete m_ring.load();
+    for (int i = 0; i < m_retired.getSize(); i++)
+        delete m_retired[i];
+}
+
+//------------------------------------------------------------------------
+
+void WorkDeque::push(const Task& task)
+{
+    S64 b = m_bottom.load(std::memory_order_relaxed);
+    S64 t = m_top.load(std::memory_order_acquire);
+    WorkRing* ring = m_ring.load(std::memory_order_relaxed);
+
+    if (b - t > ring->mask)
+    {
+        WorkRing* bigger = new WorkRing((ring->mask + 1) * 2);
+        for (S64 i = t; i < b; i++)
+            (*bigger)[i] = (*ring)[i];
+        m_retired.add(ring);
+        m_ring.store(bigger, std::memory_order_release);
+        ring = bigger;
+    }
+
+    (*ring)[b] = task;
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------
+
+bool WorkDeque::pop(Task& task)
+{
+    S64 b = m_bottom.load(std::memory_order_relaxed) - 1;
+    WorkRing* ring = m_ring.load(std::memory_order_relaxed);
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    S64 t = m_top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    task = (*ring)[b];
+    if (t < b)
+        return true;
+
+    // Last task => race the thieves for it.
+
+    bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return won;
+}
+
+//------------------------------------------------------------------------
+
+bool WorkDeque::steal(Task& task)
+{
+    S64 t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    S64 b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return false;
+
+    WorkRing* ring = m_ring.load(std::memory_order_acquire);
+    task = (*ring)[t];
+    return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------
+
+struct MulticoreLauncher::Worker
+{
+    WorkDeque               deque;
+    Spinlock                inboxLock;
+    Deque<Task>             inbox;      // Pushed from outside the pool, in push order. Guarded by inboxLock.
+    std::atomic<S32>        inboxSize;  // inbox.getSize(), for checking without the lock.
+    U32                     random;     // Picks the first victim to steal from.
+    S32                     core;       // -1 if not pinned.
+    S32                     node;       // Index into the nodes the workers are spread over.
+};
+
 //------------------------------------------------------------------------
 
 Spinlock                        MulticoreLauncher::s_lock;
@@ -37,20 +172,30 @@ S32                             MulticoreLauncher::s_numInstances   = 0;
 S32                             MulticoreLauncher::s_desiredThreads = -1;
 
 Monitor*                        MulticoreLauncher::s_monitor        = NULL;
-Deque<MulticoreLauncher::Task>  MulticoreLauncher::s_pending;
 S32                             MulticoreLauncher::s_numThreads     = 0;
+MulticoreLauncher::Worker*      MulticoreLauncher::s_workers[MaxThreads];
+std::atomic<S32>                MulticoreLauncher::s_numWorkers(0);
+std::atomic<S32>                MulticoreLauncher::s_numQueued(0);
+std::atomic<S32>                MulticoreLauncher::s_numSleeping(0);
+std::atomic<S32>                MulticoreLauncher::s_numWaiting(0);
+thread_local MulticoreLauncher::Worker* MulticoreLauncher::s_currentWorker = NULL;
+
+bool                            MulticoreLauncher::s_pinThreads     = false;
+S32                             MulticoreLauncher::s_numNodes       = 1;
+Array<Vec2i>                    MulticoreLauncher::s_coreOrder;
 
 //------------------------------------------------------------------------
 
 MulticoreLauncher::MulticoreLauncher(void)
-:   m_numTasks  (0)
+:   m_numTasks      (0),
+    m_numFinished   (0)
 {
     s_lock.enter();
 
     // First time => query the number of cores.
 
     if (s_desiredThreads == -1)
-        s_desiredThreads = getNumCores();
+        s_desiredThreads = min(getNumCores(), (int)MaxThreads);
 
     // First instance => static init.
 
@@ -84,7 +229,9 @@ MulticoreLauncher::~MulticoreLauncher(void)
 
         delete s_monitor;
         s_monitor = NULL;
-        s_pending.reset();
+        for (int i = 0; i < s_numWorkers; i++)
+            delete s_workers[i];
+        s_numWorkers = 0;
     }
 
     s_lock.leave();
@@ -92,7 +239,7 @@ MulticoreLauncher::~MulticoreLauncher(void)
 
 //------------------------------------------------------------------------
 
-MulticoreLauncher& MulticoreLauncher::push(TaskFunc func, void* data, int firstIdx, int numTasks)
+MulticoreLauncher& MulticoreLauncher::push(TaskFunc func, void* data, int firstIdx, int numTasks, int node)
 {
     FW_ASSERT(func != NULL);
     FW_ASSERT(numTasks >= 0);
@@ -100,20 +247,58 @@ MulticoreLauncher& MulticoreLauncher::push(TaskFunc func, void* data, int firstI
     if (numTasks <= 0)
         return *this;
 
-    s_monitor->enter();
+    Task task;
+    task.launcher = this;
+    task.func     = func;
+    task.data     = data;
+    task.result   = NULL;
+    m_numTasks += numTasks;
 
-    for (int i = 0; i < numTasks; i++)
+    // Pushed from a task => straight to the worker's own deque, reversed
+    // so that it runs them in order.
+
+    Worker* self = s_currentWorker;
+    if (self && (node < 0 || self->node == node % s_numNodes))
     {
-        Task& task = s_pending.addLast();
-        task.launcher = this;
-        task.func     = func;
-        task.data     = data;
-        task.idx      = firstIdx + i;
-        task.result   = NULL;
+        for (int i = numTasks - 1; i >= 0; i--)
+        {
+            task.idx = firstIdx + i;
+            self->deque.push(task);
+        }
+        s_numQueued += numTasks;
+        wakeWorkers();
+        return *this;
     }
-    m_numTasks += numTasks;
 
+    // Otherwise => deal out round-robin to the inboxes.
+
+    s_monitor->enter();
     applyNumThreads();
+
+    FW_ASSERT(s_numThreads > 0);
+    Worker* targets[MaxThreads];
+    int numTargets = 0;
+    for (int i = 0; i < s_numThreads; i++)
+        if (node < 0 || s_workers[i]->node == node % s_numNodes)
+            targets[numTargets++] = s_workers[i];
+    if (!numTargets)
+        for (int i = 0; i < s_numThreads; i++)
+            targets[numTargets++] = s_workers[i];
+
+    for (int i = 0; i < numTargets && i < numTasks; i++)
+    {
+        Worker& worker = *targets[i];
+        worker.inboxLock.enter();
+        for (int j = i; j < numTasks; j += numTargets)
+        {
+            task.idx = firstIdx + j;
+            worker.inbox.addLast(task);
+        }
+        worker.inboxSize.store(worker.inbox.getSize(), std::memory_order_release);
+        worker.inboxLock.leave();
+    }
+
+    s_numQueued += numTasks;
     s_monitor->notifyAll();
     s_monitor->leave();
     return *this;
@@ -124,18 +309,28 @@ MulticoreLauncher& MulticoreLauncher::push(TaskFunc func, void* data, int firstI
 MulticoreLauncher::Task MulticoreLauncher::pop(void)
 {
     FW_ASSERT(getNumTasks());
-    s_monitor->enter();
 
-    // Wait for a task to finish.
+    // Wait for a task to finish. Workers only take the monitor to wake
+    // us up if s_numWaiting says someone is waiting.
 
-    while (!getNumFinished())
-        s_monitor->wait();
+    if (!getNumFinished())
+    {
+        s_monitor->enter();
+        s_numWaiting++;
+        while (!getNumFinished())
+            s_monitor->wait();
+        s_numWaiting--;
+        s_monitor->leave();
+    }
 
     // Pop from the queue.
 
-    m_numTasks--;
+    m_finishedLock.enter();
     Task task = m_finished.removeFirst();
-    s_monitor->leave();
+    m_finishedLock.leave();
+
+    m_numFinished--;
+    m_numTasks--;
     return task;
 }
 
@@ -143,14 +338,14 @@ MulticoreLauncher::Task MulticoreLauncher::pop(void)
 
 int MulticoreLauncher::getNumTasks(void) const
 {
-    return m_numTasks;
+    return m_numTasks.load(std::memory_order_acquire);
 }
 
 //------------------------------------------------------------------------
 
 int MulticoreLauncher::getNumFinished(void) const
 {
-    return m_finished.getSize();
+    return m_numFinished.load(std::memory_order_acquire);
 }
 
 //------------------------------------------------------------------------
@@ -188,7 +383,7 @@ void MulticoreLauncher::setNumThreads(int numThreads)
     FW_ASSERT(numThreads > 0);
     s_lock.enter();
 
-    s_desiredThreads = numThreads;
+    s_desiredThreads = min(numThreads, (int)MaxThreads);
     if (s_numThreads != 0)
     {
         s_monitor->enter();
@@ -201,17 +396,142 @@ void MulticoreLauncher::setNumThreads(int numThreads)
 
 //------------------------------------------------------------------------
 
+int MulticoreLauncher::getNumNodes(void)
+{
+    return s_numNodes;
+}
+
+//------------------------------------------------------------------------
+
+bool MulticoreLauncher::getPinThreads(void)
+{
+    return s_pinThreads;
+}
+
+//------------------------------------------------------------------------
+
+void MulticoreLauncher::setPinThreads(bool pin)
+{
+    s_lock.enter();
+
+    if (s_pinThreads != pin)
+    {
+        s_pinThreads = pin;
+        if (pin && !s_coreOrder.getSize())
+            initCoreOrder();
+        if (s_numThreads != 0)
+            restartThreads();
+    }
+
+    s_lock.leave();
+}
+
+//------------------------------------------------------------------------
+
+void MulticoreLauncher::restartThreads(void) // Must have s_lock.
+{
+    int old = s_desiredThreads;
+    s_monitor->enter();
+    s_desiredThreads = 0;
+    applyNumThreads();
+    s_desiredThreads = old;
+    applyNumThreads();
+    s_monitor->leave();
+}
+
+//------------------------------------------------------------------------
+
+void MulticoreLauncher::initCoreOrder(void) // Must have s_lock.
+{
+    // Cores the process may run on, grouped by NUMA node.
+
+    DWORD_PTR processMask, systemMask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+        processMask = 1;
+
+    Array<Array<S32> > nodeCores;
+    Array<S32> nodeIDs;
+    for (int core = 0; core < (int)sizeof(DWORD_PTR) * 8; core++)
+    {
+        if (!(processMask & ((DWORD_PTR)1 << core)))
+            continue;
+
+        UCHAR nodeID = 0;
+        if (!GetNumaProcessorNode((UCHAR)core, &nodeID) || nodeID == 0xFF)
+            nodeID = 0;
+
+        int node = nodeIDs.indexOf(nodeID);
+        if (node == -1)
+        {
+            node = nodeIDs.getSize();
+            nodeIDs.add(nodeID);
+            nodeCores.add();
+        }
+        nodeCores[node].add(core);
+    }
+
+    // Interleave the nodes, so that any number of threads is spread evenly.
+
+    s_coreOrder.clear();
+    for (int i = 0;; i++)
+    {
+        int added = 0;
+        for (int node = 0; node < nodeCores.getSize(); node++)
+        {
+            if (i < nodeCores[node].getSize())
+            {
+                s_coreOrder.add(Vec2i(nodeCores[node][i], node));
+                added++;
+            }
+        }
+        if (!added)
+            break;
+    }
+
+    if (!s_coreOrder.getSize())
+        s_coreOrder.add(Vec2i(0, 0));
+}
+
+//------------------------------------------------------------------------
+
 void MulticoreLauncher::applyNumThreads(void) // Must have the monitor.
 {
     // Start new threads.
 
     while (s_numThreads < s_desiredThreads)
     {
-        (new Thread)->start(threadFunc, NULL);
+        if (s_numThreads == s_numWorkers)
+        {
+            s_workers[s_numThreads] = new Worker;
+            s_workers[s_numThreads]->inboxSize = 0;
+            s_workers[s_numThreads]->random = s_numThreads * 0x9E3779B9u + 1;
+            s_numWorkers++;
+        }
+
+        // More threads than cores => the extra ones share, round-robin.
+
+        Worker& worker = *s_workers[s_numThreads];
+        worker.core = -1;
+        worker.node = 0;
+        if (s_pinThreads)
+        {
+            const Vec2i& coreNode = s_coreOrder[s_numThreads % s_coreOrder.getSize()];
+            worker.core = coreNode.x;
+            worker.node = coreNode.y;
+        }
+
+        (new Thread)->start(threadFunc, &worker);
         s_numThreads++;
     }
 
-    // Kill excess threads.
+    // Nodes with a live worker. s_coreOrder interleaves them from node 0
+    // up, so the first s_numThreads slots never skip one.
+
+    s_numNodes = 1;
+    for (int i = 0; i < min(s_numThreads, s_desiredThreads); i++)
+        s_numNodes = max(s_numNodes, s_workers[i]->node + 1);
+
+    // Kill excess threads. They leave once there is nothing left to run.
 
     if (s_numThreads > s_desiredThreads)
     {
@@ -223,41 +543,137 @@ void MulticoreLauncher::applyNumThreads(void) // Must have the monitor.
 
 //------------------------------------------------------------------------
 
+bool MulticoreLauncher::findTask(Worker& self, Task& task)
+{
+    // Own deque first, refilled from the inbox when empty. The inbox goes
+    // in reversed, so that popping from the bottom runs it in push order
+    // and thieves get the last tasks pushed.
+
+    bool found = self.deque.pop(task);
+    if (!found && self.inboxSize.load(std::memory_order_acquire))
+    {
+        self.inboxLock.enter();
+        while (self.inbox.getSize())
+            self.deque.push(self.inbox.removeLast());
+        self.inboxSize.store(0, std::memory_order_release);
+        self.inboxLock.leave();
+        found = self.deque.pop(task);
+    }
+
+    // Steal, starting from a random victim. Workers on the same NUMA node
+    // go first; the others only once the node has nothing left.
+
+    int numWorkers = s_numWorkers.load(std::memory_order_acquire);
+    self.random = self.random * 1664525u + 1013904223u;
+    int first = (int)((self.random >> 8) % (U32)numWorkers);
+
+    for (int i = 0; i < numWorkers * 2 && !found; i++)
+    {
+        Worker& victim = *s_workers[(first + i) % numWorkers];
+        if (&victim == &self || (victim.node == self.node) != (i < numWorkers))
+            continue;
+
+        found = victim.deque.steal(task);
+        if (!found && victim.inboxSize.load(std::memory_order_acquire))
+        {
+            victim.inboxLock.enter();
+            if (victim.inbox.getSize())
+            {
+                task = victim.inbox.removeLast();
+                victim.inboxSize.store(victim.inbox.getSize(), std::memory_order_release);
+                found = true;
+            }
+            victim.inboxLock.leave();
+        }
+    }
+
+    if (found)
+        s_numQueued--;
+    return found;
+}
+
+//------------------------------------------------------------------------
+
+void MulticoreLauncher::finishTask(const Task& task)
+{
+    MulticoreLauncher* launcher = task.launcher;
+    launcher->m_finishedLock.enter();
+    launcher->m_finished.addLast(task);
+    launcher->m_finishedLock.leave();
+
+    // The launcher may be gone as soon as the count is up; only statics
+    // are touched after it.
+
+    launcher->m_numFinished++;
+    if (s_numWaiting.load())
+    {
+        s_monitor->enter();
+        s_monitor->notifyAll();
+        s_monitor->leave();
+    }
+}
+
+//------------------------------------------------------------------------
+
+void MulticoreLauncher::wakeWorkers(void)
+{
+    if (s_numSleeping.load())
+    {
+        s_monitor->enter();
+        s_monitor->notifyAll();
+        s_monitor->leave();
+    }
+}
+
+//------------------------------------------------------------------------
+
 void MulticoreLauncher::threadFunc(void* param)
 {
-    FW_UNREF(param);
+    Worker& self = *(Worker*)param;
+    s_currentWorker = &self;
     Thread::getCurrent()->setPriority(Thread::Priority_Min);
-    s_monitor->enter();
+    if (self.core != -1 && !SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << self.core))
+        failWin32Error("SetThreadAffinityMask");
 
-    while (s_numThreads <= s_desiredThreads)
+    for (;;)
     {
-        // No pending tasks => wait.
+        // Execute.
 
-        if (!s_pending.getSize())
+        Task task;
+        if (findTask(self, task))
         {
-            s_monitor->wait();
+            task.func(task);
+            failIfError();
+            finishTask(task);
             continue;
         }
 
-        // Pick a task.
+        // Queued tasks we failed to get => another worker is about to
+        // run them, or lost a race; try again.
 
-        Task task = s_pending.removeFirst();
-        MulticoreLauncher* launcher = task.launcher;
+        if (s_numQueued.load())
+        {
+            Thread::yield();
+            continue;
+        }
 
-        // Execute.
+        // No pending tasks => exit if excess, otherwise wait. Threads exit
+        // from the highest slot down, so the live ones always fill the
+        // first s_numThreads slots.
 
-        s_monitor->leave();
-        task.func(task);
-        failIfError();
         s_monitor->enter();
+        if (s_numThreads > s_desiredThreads && s_workers[s_numThreads - 1] == &self)
+            break;
 
-        // Mark as finished.
-
-        launcher->m_finished.addLast(task);
-        s_monitor->notifyAll();
+        s_numSleeping++;
+        if (!s_numQueued.load())
+            s_monitor->wait();
+        s_numSleeping--;
+        s_monitor->leave();
     }
 
     s_numThreads--;
+    s_currentWorker = NULL;
     delete Thread::getCurrent();
     s_monitor->notifyAll();
     s_monitor->leave();
@@ -29,6 +29,8 @@
 #include "base/Thread.hpp"
 #include "base/Deque.hpp"
 
+#include <atomic>
+
 namespace FW
 {
 //------------------------------------------------------------------------
@@ -84,6 +86,20 @@ namespace FW
 //     }
 //     ...
 // }
+//
+// Scheduling:
+//
+// Every worker thread owns a Chase-Lev deque and runs its own tasks in
+// push order; idle workers steal from the other end of someone else's.
+// push() deals tasks out round-robin, so the first ones pushed are the
+// first to run, and tasks pushed from inside a task go to the deque of
+// the worker running it. The shared monitor is only taken to sleep,
+// wake up, or change the number of threads.
+//
+// With setPinThreads(true), each worker is pinned to a core of its own,
+// spread evenly over the NUMA nodes. Workers then steal from their own
+// node first, and push() can aim tasks at one node, e.g. the one whose
+// threads first touched the memory the tasks write to.
 //------------------------------------------------------------------------
 
 class MulticoreLauncher
@@ -105,7 +121,7 @@ public:
                             MulticoreLauncher   (void);
                             ~MulticoreLauncher  (void);
 
-    MulticoreLauncher&      push                (TaskFunc func, void* data, int firstIdx = 0, int numTasks = 1);
+    MulticoreLauncher&      push                (TaskFunc func, void* data, int firstIdx = 0, int numTasks = 1, int node = -1); // node < 0 => any, otherwise modulo getNumNodes().
     Task                    pop                 (void);         // Blocks until at least one task has finished.
 
     int                     getNumTasks         (void) const;   // Tasks that have been pushed but not popped.
@@ -116,25 +132,48 @@ public:
 
     static int              getNumCores         (void);
     static void             setNumThreads       (int numThreads);
+    static int              getNumNodes         (void);         // NUMA nodes the workers are spread over; 1 unless pinned.
+    static bool             getPinThreads       (void);
+    static void             setPinThreads       (bool pin);     // Restarts the threads; blocks until the running tasks are done.
 
 private:
+    struct Worker;
+
     static void             applyNumThreads     (void);
+    static void             restartThreads      (void);
+    static void             initCoreOrder       (void);
     static void             threadFunc          (void* param);
+    static bool             findTask            (Worker& self, Task& task);
+    static void             finishTask          (const Task& task);
+    static void             wakeWorkers         (void);
 
 private:
                             MulticoreLauncher   (const MulticoreLauncher&); // forbidden
     MulticoreLauncher&      operator=           (const MulticoreLauncher&); // forbidden
 
 private:
+    enum { MaxThreads = 256 };
+
     static Spinlock         s_lock;
     static S32              s_numInstances;
     static S32              s_desiredThreads;
 
     static Monitor*         s_monitor;
-    static Deque<Task>      s_pending;
     static S32              s_numThreads;
+    static Worker*          s_workers[MaxThreads];  // Kept while any instance exists; a thread's slot is its index.
+    static std::atomic<S32> s_numWorkers;           // Slots of s_workers in use.
+    static std::atomic<S32> s_numQueued;            // Pushed but not yet started.
+    static std::atomic<S32> s_numSleeping;          // Workers waiting for tasks.
+    static std::atomic<S32> s_numWaiting;           // Threads waiting in pop().
+    static thread_local Worker* s_currentWorker;    // NULL outside the pool.
+
+    static bool             s_pinThreads;
+    static S32              s_numNodes;
+    static Array<Vec2i>     s_coreOrder;            // (core, node) to pin each slot to, nodes interleaved.
 
-    S32                     m_numTasks;
+    std::atomic<S32>        m_numTasks;
+    std::atomic<S32>        m_numFinished;
+    Spinlock                m_finishedLock;
     Deque<Task>             m_finished;
 };
 
@@ -28,6 +28,10 @@
 #include "base/Random.hpp"
 #include "base/DLLImports.hpp"
 
+#if FW_HEADLESS
+#   include <chrono>
+#endif
+
 using namespace FW;
 
 //------------------------------------------------------------------------
@@ -97,10 +101,14 @@ public:
 
 void Random::reset(void)
 {
+#if FW_HEADLESS
+    reset((U32)std::chrono::high_resolution_clock::now().time_since_epoch().count());
+#else
     LARGE_INTEGER ticks;
     if (!QueryPerformanceCounter(&ticks))
         failWin32Error("QueryPerformanceCounter");
     reset(ticks.LowPart);
+#endif
 }
 
 //------------------------------------------------------------------------
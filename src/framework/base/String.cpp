@@ -30,9 +30,37 @@
 #include <stdio.h>
 #include <time.h>
 #include <ctype.h>
+#include <stdarg.h>
 
 using namespace FW;
 
+//------------------------------------------------------------------------
+// Secure CRT equivalents for headless builds with other compilers. Unlike
+// MSVC's, a va_list is consumed when passed on, so the counting pass copies it.
+
+#ifndef _MSC_VER
+
+static int _vscprintf(const char* fmt, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    return len;
+}
+
+static int vsprintf_s(char* buffer, size_t size, const char* fmt, va_list args)
+{
+    return vsnprintf(buffer, size, fmt, args);
+}
+
+static int ctime_s(char* buffer, size_t size, const time_t* time)
+{
+    return (size >= 26 && ctime_r(time, buffer)) ? 0 : -1;
+}
+
+#endif
+
 //------------------------------------------------------------------------
 
 String& String::set(char chr)
@@ -31,6 +31,37 @@
 
 using namespace FW;
 
+//------------------------------------------------------------------------
+// Secure CRT equivalents for headless builds with other compilers, see String.cpp.
+
+#ifndef _MSC_VER
+
+static int _vscprintf(const char* fmt, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int size = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    return size;
+}
+
+static int vsprintf_s(char* buffer, size_t size, const char* fmt, va_list args)
+{
+    return vsnprintf(buffer, size, fmt, args);
+}
+
+// Returns -1 instead of the full length when the output does not fit.
+static int vsnprintf_s(char* buffer, size_t size, size_t count, const char* fmt, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(buffer, size, fmt, copy);
+    va_end(copy);
+    return (len < 0 || (size_t)len > count) ? -1 : len;
+}
+
+#endif
+
 //------------------------------------------------------------------------
 
 void InputStream::readFully(void* ptr, int size)
@@ -48,9 +79,9 @@ void InputStream::readFully(void* ptr, int size)
 
 BufferedInputStream::BufferedInputStream(InputStream& stream, int bufferSize)
 :   m_stream        (stream),
+    m_buffer        (NULL, bufferSize),
     m_numRead       (0),
-    m_numConsumed   (0),
-    m_buffer        (NULL, bufferSize)
+    m_numConsumed   (0)
 {
     FW_ASSERT(bufferSize > 0);
 }
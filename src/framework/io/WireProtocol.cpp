@@ -0,0 +1,376 @@
+#include "io/WireProtocol.hpp"
+
+using namespace FW;
+
+//------------------------------------------------------------------------
+
+static const int s_frameHeaderSize      = 12;
+static const int s_messageHeaderSize    = 8;
+
+static void patchU16LE(U8* p, U32 v) { p[0] = (U8)v; p[1] = (U8)(v >> 8); }
+static void patchU32LE(U8* p, U32 v) { p[0] = (U8)v; p[1] = (U8)(v >> 8); p[2] = (U8)(v >> 16); p[3] = (U8)(v >> 24); }
+static U32  peekU16LE (const U8* p)  { return p[0] | (p[1] << 8); }
+static U32  peekU32LE (const U8* p)  { return p[0] | (p[1] << 8) | (p[2] << 16) | ((U32)p[3] << 24); }
+
+// Strings are an S32 length and the characters, as written by operator<<.
+static bool readString(WireReader& r, String& s)
+{
+    if (r.getPayloadLeft() < 4)
+        return false;
+    S32 len;
+    r.getPayload() >> len;
+    if (len < 0 || len > r.getPayloadLeft())
+        return false;
+
+    Array<char> t(NULL, len + 1);
+    r.getPayload().readFully(t.getPtr(), len);
+    t[len] = '\0';
+    s.set(t.getPtr());
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+void WireWriter::clear(void)
+{
+    m_stream.clear();
+    for (int i = 0; i < s_frameHeaderSize; i++)
+        m_stream << (U8)0;
+    m_numMessages = 0;
+    m_messageStart = -1;
+}
+
+//------------------------------------------------------------------------
+
+OutputStream& WireWriter::beginMessage(WireMessageType type)
+{
+    FW_ASSERT(m_messageStart == -1);
+    m_stream << (U16)type << (U16)0 << (U32)0;
+    m_messageStart = m_stream.getData().getSize();
+    return m_stream;
+}
+
+//------------------------------------------------------------------------
+
+void WireWriter::endMessage(void)
+{
+    FW_ASSERT(m_messageStart != -1);
+    Array<U8>& data = m_stream.getData();
+    patchU32LE(data.getPtr(m_messageStart - 4), data.getSize() - m_messageStart);
+    m_numMessages++;
+    m_messageStart = -1;
+}
+
+//------------------------------------------------------------------------
+
+void WireWriter::append(const WireWriter& other)
+{
+    FW_ASSERT(m_messageStart == -1 && other.m_messageStart == -1);
+    const Array<U8>& data = other.m_stream.getData();
+    m_stream.write(data.getPtr(s_frameHeaderSize), data.getSize() - s_frameHeaderSize);
+    m_numMessages += other.m_numMessages;
+}
+
+//------------------------------------------------------------------------
+
+const Array<U8>& WireWriter::finish(U32 epoch)
+{
+    FW_ASSERT(m_messageStart == -1 && m_numMessages <= 0xFFFF);
+    Array<U8>& data = m_stream.getData();
+    patchU32LE(data.getPtr(0), WireMagic);
+    patchU16LE(data.getPtr(4), WireVersion);
+    patchU16LE(data.getPtr(6), m_numMessages);
+    patchU32LE(data.getPtr(8), epoch);
+    return data;
+}
+
+//------------------------------------------------------------------------
+
+bool WireReader::reset(const void* ptr, int size)
+{
+    m_ptr = (const U8*)ptr;
+    m_size = 0;
+    m_ofs = 0;
+    m_numLeft = 0;
+    m_epoch = 0;
+    m_type = (WireMessageType)0;
+    m_messageSize = 0;
+    m_payloadOfs = 0;
+    m_payload.reset();
+
+    if (!ptr || size < s_frameHeaderSize)
+        return false;
+    if (peekU32LE(m_ptr) != WireMagic || peekU16LE(m_ptr + 4) != WireVersion)
+        return false;
+
+    // Walk the message sizes once so a truncated frame is rejected before anything is applied.
+    int numMessages = peekU16LE(m_ptr + 6);
+    int ofs = s_frameHeaderSize;
+    for (int i = 0; i < numMessages; i++)
+    {
+        if (size - ofs < s_messageHeaderSize)
+            return false;
+        U32 messageSize = peekU32LE(m_ptr + ofs + 4);
+        if (messageSize > (U32)(size - ofs - s_messageHeaderSize))
+            return false;
+        ofs += s_messageHeaderSize + messageSize;
+    }
+    if (ofs != size)
+        return false;
+
+    m_size = size;
+    m_ofs = s_frameHeaderSize;
+    m_numLeft = numMessages;
+    m_epoch = peekU32LE(m_ptr + 8);
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+bool WireReader::nextMessage(void)
+{
+    if (m_numLeft == 0)
+        return false;
+
+    m_type = (WireMessageType)peekU16LE(m_ptr + m_ofs);
+    m_messageSize = peekU32LE(m_ptr + m_ofs + 4);
+    m_payloadOfs = m_ofs + s_messageHeaderSize;
+    m_payload.reset(m_ptr + m_payloadOfs, m_messageSize);
+    m_ofs += s_messageHeaderSize + m_messageSize;
+    m_numLeft--;
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+void FW::writeWire(WireWriter& w, const WireCameraState& m)
+{
+    w.beginMessage(WireMessage_CameraState) << m.sequence << m.position << m.forward << m.up << m.fov;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireLight& m)
+{
+    w.beginMessage(WireMessage_Light) << m.position << m.orientation;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireRenderSettings& m)
+{
+    w.beginMessage(WireMessage_RenderSettings) << m.rtMode << m.jbf << m.normalMapped << m.russianRoulette
+        << m.kernel << m.spp << m.numBounces << m.frameEncoding << m.frameFlags << m.pullTiles << m.framesInFlight;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireResize& m)
+{
+    w.beginMessage(WireMessage_Resize) << m.size;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireScene& m)
+{
+    w.beginMessage(WireMessage_Scene) << m.fileName;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireHeartbeat& m)
+{
+    w.beginMessage(WireMessage_Heartbeat) << m.sequence;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireStripAssignment& m)
+{
+    w.beginMessage(WireMessage_StripAssignment) << m.blockId << m.blockNum << m.vStart << m.vHeight;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireTileAssignment& m)
+{
+    w.beginMessage(WireMessage_TileAssignment) << m.tileId << m.x << m.y << m.width << m.height;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireSceneManifest& m)
+{
+    OutputStream& s = w.beginMessage(WireMessage_SceneManifest);
+    s << m.meshMD5 << (U16)m.assets.getSize();
+    for (int i = 0; i < m.assets.getSize(); i++)
+        s << m.assets[i].kind << m.assets[i].hash << m.assets[i].size;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireAssetRequest& m)
+{
+    w.beginMessage(WireMessage_AssetRequest) << m.hash << m.offset << m.size;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireAssetChunk& m)
+{
+    OutputStream& s = w.beginMessage(WireMessage_AssetChunk);
+    s << m.hash << m.offset << m.totalSize << m.size;
+    s.write(m.data, m.size);
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireFrameCredit& m)
+{
+    w.beginMessage(WireMessage_FrameCredit) << m.credits;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WireFoveation& m)
+{
+    w.beginMessage(WireMessage_Foveation) << m.enabled << m.focus << m.radius << m.falloff << m.minScale;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, const WirePreview& m)
+{
+    w.beginMessage(WireMessage_Preview) << m.scale;
+    w.endMessage();
+}
+
+void FW::writeWire(WireWriter& w, WireMessageType emptyMessage)
+{
+    w.beginMessage(emptyMessage);
+    w.endMessage();
+}
+
+//------------------------------------------------------------------------
+
+bool FW::readWire(WireReader& r, WireCameraState& m)
+{
+    if (r.getType() != WireMessage_CameraState || r.getSize() < 44)
+        return false;
+    r.getPayload() >> m.sequence >> m.position >> m.forward >> m.up >> m.fov;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireLight& m)
+{
+    if (r.getType() != WireMessage_Light || r.getSize() < 48)
+        return false;
+    r.getPayload() >> m.position >> m.orientation;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireRenderSettings& m)
+{
+    if (r.getType() != WireMessage_RenderSettings || r.getSize() < 19)
+        return false;
+    r.getPayload() >> m.rtMode >> m.jbf >> m.normalMapped >> m.russianRoulette
+        >> m.kernel >> m.spp >> m.numBounces >> m.frameEncoding >> m.frameFlags >> m.pullTiles;
+    m.framesInFlight = 0;
+    if (r.getPayloadLeft() >= 1)
+        r.getPayload() >> m.framesInFlight;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireResize& m)
+{
+    if (r.getType() != WireMessage_Resize || r.getSize() < 8)
+        return false;
+    r.getPayload() >> m.size;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireScene& m)
+{
+    return r.getType() == WireMessage_Scene && readString(r, m.fileName);
+}
+
+bool FW::readWire(WireReader& r, WireHeartbeat& m)
+{
+    if (r.getType() != WireMessage_Heartbeat)
+        return false;
+    // Heartbeats of older servers carry no payload.
+    m.sequence = 0;
+    if (r.getSize() >= 4)
+        r.getPayload() >> m.sequence;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireStripAssignment& m)
+{
+    if (r.getType() != WireMessage_StripAssignment || r.getSize() < 16)
+        return false;
+    r.getPayload() >> m.blockId >> m.blockNum >> m.vStart >> m.vHeight;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireTileAssignment& m)
+{
+    if (r.getType() != WireMessage_TileAssignment || r.getSize() < 20)
+        return false;
+    r.getPayload() >> m.tileId >> m.x >> m.y >> m.width >> m.height;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireSceneManifest& m)
+{
+    if (r.getType() != WireMessage_SceneManifest || !readString(r, m.meshMD5) || r.getPayloadLeft() < 2)
+        return false;
+    U16 numAssets;
+    r.getPayload() >> numAssets;
+
+    m.assets.reset(numAssets);
+    for (int i = 0; i < numAssets; i++)
+    {
+        WireAsset& a = m.assets[i];
+        if (r.getPayloadLeft() < 1)
+            return false;
+        r.getPayload() >> a.kind;
+        if (!readString(r, a.hash) || r.getPayloadLeft() < 4)
+            return false;
+        r.getPayload() >> a.size;
+    }
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireFrameCredit& m)
+{
+    if (r.getType() != WireMessage_FrameCredit || r.getSize() < 4)
+        return false;
+    r.getPayload() >> m.credits;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireFoveation& m)
+{
+    if (r.getType() != WireMessage_Foveation || r.getSize() < 21)
+        return false;
+    r.getPayload() >> m.enabled >> m.focus >> m.radius >> m.falloff >> m.minScale;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WirePreview& m)
+{
+    if (r.getType() != WireMessage_Preview || r.getSize() < 1)
+        return false;
+    r.getPayload() >> m.scale;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireAssetRequest& m)
+{
+    if (r.getType() != WireMessage_AssetRequest || !readString(r, m.hash) || r.getPayloadLeft() < 8)
+        return false;
+    r.getPayload() >> m.offset >> m.size;
+    return true;
+}
+
+bool FW::readWire(WireReader& r, WireAssetChunk& m)
+{
+    if (r.getType() != WireMessage_AssetChunk || !readString(r, m.hash) || r.getPayloadLeft() < 12)
+        return false;
+    r.getPayload() >> m.offset >> m.totalSize >> m.size;
+    if (m.size < 0 || m.size > r.getPayloadLeft())
+        return false;
+    m.data = r.getPayloadPtr();
+    return true;
+}
+
+//------------------------------------------------------------------------
@@ -0,0 +1,282 @@
+#pragma once
+#include "io/Stream.hpp"
+
+namespace FW
+{
+//------------------------------------------------------------------------
+// Framed binary protocol for the control and state traffic between the client and the
+// render servers: the input PUB socket and the control ROUTER socket. A frame is a header
+// followed by any number of length-prefixed messages, little-endian and without padding:
+//
+//     U32 magic, U16 version, U16 numMessages, U32 epoch
+//     numMessages x { U16 type, U16 reserved, U32 size, size bytes of payload }
+//
+// The epoch is the CameraControls epoch the frame starts. Readers skip message types they
+// do not know and ignore trailing bytes of the ones they do, so fields can be appended to a
+// message without breaking older peers. Anything else bumps WireVersion, and frames of
+// another version are rejected whole instead of being misread.
+//------------------------------------------------------------------------
+
+enum
+{
+    WireMagic   = 0x31575450,   // "PTW1"
+    WireVersion = 1
+};
+
+enum WireMessageType
+{
+    WireMessage_CameraState = 1,    // WireCameraState
+    WireMessage_Light,              // WireLight
+    WireMessage_RenderSettings,     // WireRenderSettings; rtMode false stops rendering.
+    WireMessage_Resize,             // WireResize
+    WireMessage_Scene,              // WireScene
+    WireMessage_Shutdown,           // No payload.
+    WireMessage_Heartbeat,          // WireHeartbeat; servers echo it back unchanged.
+    WireMessage_StripAssignment,    // WireStripAssignment
+    WireMessage_TileRequest,        // No payload; the frame epoch is the one the server renders.
+    WireMessage_TileAssignment,     // WireTileAssignment
+    WireMessage_SceneManifest,      // WireSceneManifest
+    WireMessage_AssetRequest,       // WireAssetRequest
+    WireMessage_AssetChunk,         // WireAssetChunk
+    WireMessage_FrameCredit,        // WireFrameCredit
+    WireMessage_Foveation,          // WireFoveation
+    WireMessage_Preview             // WirePreview
+};
+
+enum
+{
+    WireMaxAssetChunk = 256 << 10   // Larger asset requests are answered with this much.
+};
+
+//------------------------------------------------------------------------
+
+struct WireCameraState
+{
+    U32     sequence;       // Servers ignore snapshots no newer than the last one applied.
+    Vec3f   position;
+    Vec3f   forward;
+    Vec3f   up;
+    F32     fov;
+};
+
+struct WireLight
+{
+    Vec3f   position;
+    Mat3f   orientation;
+};
+
+struct WireRenderSettings
+{
+    bool    rtMode;
+    bool    jbf;
+    bool    normalMapped;
+    bool    russianRoulette;
+    S32     kernel;
+    S32     spp;
+    S32     numBounces;
+    U8      frameEncoding;  // FrameEncoding
+    U8      frameFlags;     // FrameFlags
+    bool    pullTiles;      // Request tiles instead of rendering the assigned strip.
+    U8      framesInFlight; // Credit window, see WireFrameCredit; 0 for no flow control.
+};
+
+struct WireResize
+{
+    Vec2f   size;
+};
+
+struct WireScene
+{
+    String  fileName;
+};
+
+struct WireHeartbeat
+{
+    U32     sequence;       // 0 in heartbeats that are not echoes of a ping.
+};
+
+struct WireStripAssignment
+{
+    S32     blockId;
+    S32     blockNum;
+    S32     vStart;
+    S32     vHeight;
+};
+
+struct WireTileAssignment
+{
+    S32     tileId;         // -1 if every tile is in flight; ask again shortly.
+    S32     x;
+    S32     y;
+    S32     width;
+    S32     height;
+};
+
+// Credit-based flow control for pipelined rendering. With a window of N, a server may have
+// up to N frames of an epoch sent but not yet consumed by the client, and keeps rendering
+// the next batch while earlier ones are in transit. The client grants credits back for the
+// frames it has merged; every new epoch starts over with a full window. A server that has
+// had no credit for a second may assume a grant was lost and take one.
+struct WireFrameCredit
+{
+    U32     credits;        // For the epoch of the frame carrying the message.
+};
+
+// Region of interest that gets rendered first and with the most samples, see Foveation.hpp.
+struct WireFoveation
+{
+    bool    enabled;
+    Vec2f   focus;          // In image coordinates scaled to [0,1], y down.
+    F32     radius;         // Full rate within this distance, in image heights.
+    F32     falloff;        // Width of the transition to the periphery, in image heights.
+    F32     minScale;       // Fraction of the samples per pixel left in the periphery.
+};
+
+// Reduced-resolution rendering while the camera moves. Servers shade one pixel per
+// scale x scale and tag their frames accordingly (FrameCodec.hpp), until a scale of 1
+// restores full resolution.
+struct WirePreview
+{
+    U8      scale;          // 1, 2 or 4.
+};
+
+// Scene data a server can fetch instead of loading its own copy of the files. Assets are
+// content-addressed: servers cache them by hash and only request the ones they lack.
+enum WireAssetKind
+{
+    WireAsset_Mesh = 0,     // exportBinaryMesh output, textures included.
+    WireAsset_Hierarchy     // RayTracer::saveHierarchy output for the mesh's triangles.
+};
+
+struct WireAsset
+{
+    U8      kind;           // WireAssetKind
+    String  hash;           // RayTracer::computeMD5 of the data.
+    U32     size;
+};
+
+struct WireSceneManifest
+{
+    String              meshMD5;    // RayTracer::computeMD5 of the vertex positions.
+    Array<WireAsset>    assets;
+};
+
+// Chunks are pulled one request at a time, so an interrupted transfer resumes at the
+// first byte the server is missing.
+struct WireAssetRequest
+{
+    String  hash;
+    U32     offset;
+    U32     size;
+};
+
+struct WireAssetChunk
+{
+    String      hash;
+    U32         offset;
+    U32         totalSize;
+    const U8*   data;       // Points into the frame when read.
+    S32         size;
+};
+
+//------------------------------------------------------------------------
+
+class WireWriter
+{
+public:
+                            WireWriter          (void)          { clear(); }
+
+    void                    clear               (void);
+
+    // Payload goes to the returned stream between beginMessage and endMessage.
+    OutputStream&           beginMessage        (WireMessageType type);
+    void                    endMessage          (void);
+
+    void                    append              (const WireWriter& other);  // Copies the other's messages.
+    int                     getNumMessages      (void) const    { return m_numMessages; }
+
+    // Fills in the header; the result stays valid until the writer is modified.
+    const Array<U8>&        finish              (U32 epoch);
+
+private:
+                            WireWriter          (const WireWriter&); // forbidden
+    WireWriter&             operator=           (const WireWriter&); // forbidden
+
+private:
+    MemoryOutputStream      m_stream;
+    S32                     m_numMessages;
+    S32                     m_messageStart;     // -1 outside beginMessage/endMessage.
+};
+
+//------------------------------------------------------------------------
+
+class WireReader
+{
+public:
+                            WireReader          (void)          { reset(NULL, 0); }
+
+    // Returns false if the data is not a well-formed frame of WireVersion.
+    bool                    reset               (const void* ptr, int size);
+
+    U32                     getEpoch            (void) const    { return m_epoch; }
+
+    // Advances to the next message, false at the end of the frame.
+    bool                    nextMessage         (void);
+    WireMessageType         getType             (void) const    { return m_type; }
+    int                     getSize             (void) const    { return m_messageSize; }
+    InputStream&            getPayload          (void)          { return m_payload; }
+    const U8*               getPayloadPtr       (void) const    { return m_ptr + m_payloadOfs + m_payload.getOffset(); }
+    int                     getPayloadLeft      (void) const    { return m_messageSize - m_payload.getOffset(); }
+
+private:
+                            WireReader          (const WireReader&); // forbidden
+    WireReader&             operator=           (const WireReader&); // forbidden
+
+private:
+    const U8*               m_ptr;
+    S32                     m_size;
+    S32                     m_ofs;
+    S32                     m_numLeft;
+    U32                     m_epoch;
+    WireMessageType         m_type;
+    S32                     m_messageSize;
+    S32                     m_payloadOfs;
+    MemoryInputStream       m_payload;
+};
+
+//------------------------------------------------------------------------
+// Typed messages. Reads return false if the current message is too short for the type.
+
+void    writeWire   (WireWriter& w, const WireCameraState& m);
+void    writeWire   (WireWriter& w, const WireLight& m);
+void    writeWire   (WireWriter& w, const WireRenderSettings& m);
+void    writeWire   (WireWriter& w, const WireResize& m);
+void    writeWire   (WireWriter& w, const WireScene& m);
+void    writeWire   (WireWriter& w, const WireHeartbeat& m);
+void    writeWire   (WireWriter& w, const WireStripAssignment& m);
+void    writeWire   (WireWriter& w, const WireTileAssignment& m);
+void    writeWire   (WireWriter& w, const WireSceneManifest& m);
+void    writeWire   (WireWriter& w, const WireAssetRequest& m);
+void    writeWire   (WireWriter& w, const WireAssetChunk& m);
+void    writeWire   (WireWriter& w, const WireFrameCredit& m);
+void    writeWire   (WireWriter& w, const WireFoveation& m);
+void    writeWire   (WireWriter& w, const WirePreview& m);
+void    writeWire   (WireWriter& w, WireMessageType emptyMessage);
+
+bool    readWire    (WireReader& r, WireCameraState& m);
+bool    readWire    (WireReader& r, WireLight& m);
+bool    readWire    (WireReader& r, WireRenderSettings& m);
+bool    readWire    (WireReader& r, WireResize& m);
+bool    readWire    (WireReader& r, WireScene& m);
+bool    readWire    (WireReader& r, WireHeartbeat& m);
+bool    readWire    (WireReader& r, WireStripAssignment& m);
+bool    readWire    (WireReader& r, WireTileAssignment& m);
+bool    readWire    (WireReader& r, WireSceneManifest& m);
+bool    readWire    (WireReader& r, WireAssetRequest& m);
+bool    readWire    (WireReader& r, WireAssetChunk& m);
+bool    readWire    (WireReader& r, WireFrameCredit& m);
+bool    readWire    (WireReader& r, WireFoveation& m);
+bool    readWire    (WireReader& r, WirePreview& m);
+
+//------------------------------------------------------------------------
+}
@@ -0,0 +1,159 @@
+#include "base/Defs.hpp"
+#include "base/String.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <mutex>
+
+using namespace FW;
+
+//------------------------------------------------------------------------
+// Common functionality and error handling of base/Defs.hpp for FW_HEADLESS
+// programs, which link neither framework/base/Defs.cpp nor the Win32 and GL
+// code it needs. Logging and profiling are left out; fatal errors go to stderr
+// instead of a message box.
+//------------------------------------------------------------------------
+
+static std::mutex               s_lock;
+static bool                     s_hasFailed     = false;
+static thread_local String*     s_error         = NULL;
+static String                   s_emptyString;
+
+//------------------------------------------------------------------------
+
+void* FW::malloc(size_t size)
+{
+    void* ptr = ::malloc(size);
+    if (!ptr && size)
+        fail("Out of memory!");
+    return ptr;
+}
+
+//------------------------------------------------------------------------
+
+void FW::free(void* ptr)
+{
+    ::free(ptr);
+}
+
+//------------------------------------------------------------------------
+
+void* FW::realloc(void* ptr, size_t size)
+{
+    if (!size)
+    {
+        ::free(ptr);
+        return NULL;
+    }
+
+    void* newPtr = ::realloc(ptr, size);
+    if (!newPtr)
+        fail("Out of memory!");
+    return newPtr;
+}
+
+//------------------------------------------------------------------------
+
+void FW::printf(const char* fmt, ...)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    fflush(stdout);
+}
+
+//------------------------------------------------------------------------
+
+String FW::sprintf(const char* fmt, ...)
+{
+    String str;
+    va_list args;
+    va_start(args, fmt);
+    str.setfv(fmt, args);
+    va_end(args);
+    return str;
+}
+
+//------------------------------------------------------------------------
+
+void FW::setError(const char* fmt, ...)
+{
+    if (hasError())
+        return;
+
+    s_error = new String;
+    va_list args;
+    va_start(args, fmt);
+    s_error->setfv(fmt, args);
+    va_end(args);
+}
+
+//------------------------------------------------------------------------
+
+String FW::clearError(void)
+{
+    String old = getError();
+    delete s_error;
+    s_error = NULL;
+    return old;
+}
+
+//------------------------------------------------------------------------
+
+bool FW::restoreError(const String& old)
+{
+    bool had = hasError();
+    delete s_error;
+    s_error = (old.getLength()) ? new String(old) : NULL;
+    return had;
+}
+
+//------------------------------------------------------------------------
+
+bool FW::hasError(void)
+{
+    return (s_error != NULL);
+}
+
+//------------------------------------------------------------------------
+
+const String& FW::getError(void)
+{
+    return (s_error) ? *s_error : s_emptyString;
+}
+
+//------------------------------------------------------------------------
+
+void FW::fail(const char* fmt, ...)
+{
+    // Fail only once.
+
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (s_hasFailed)
+            return;
+        s_hasFailed = true;
+    }
+
+    String tmp;
+    va_list args;
+    va_start(args, fmt);
+    tmp.setfv(fmt, args);
+    va_end(args);
+    fprintf(stderr, "\nFatal error: %s\n", tmp.getPtr());
+
+    abort();
+}
+
+//------------------------------------------------------------------------
+
+void FW::failIfError(void)
+{
+    if (hasError())
+        fail("%s", getError().getPtr());
+}
+
+//------------------------------------------------------------------------
@@ -0,0 +1,77 @@
+// Headless stand-in render servers, for testing the client's networking without server
+// machines, see LoopbackServer.hpp. Built from portable code only (ZeroMQ, the wire
+// protocol and the frame codec), so it runs on any machine that has ZeroMQ:
+//
+//     standin -loopback 4 -loopback_host client-machine -loopback_throughput 50
+//
+// Stops when Enter is pressed, or on SIGINT or SIGTERM, which is the only way when it
+// runs without a terminal.
+
+#include "LoopbackServer.hpp"
+
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+
+using namespace FW;
+
+
+static std::atomic<bool> s_quit(false);
+
+static void onSignal(int)
+{
+	s_quit = true;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> args(argv + 1, argv + argc);
+	LoopbackConfig config;
+	int count = max(LoopbackServer::parseArgs(args, config), 1);
+
+	// Identities must not collide with those of other stand-in processes.
+	U32 instance = (U32)std::chrono::steady_clock::now().time_since_epoch().count();
+	std::vector<std::unique_ptr<LoopbackServer> > servers;
+	for (int i = 0; i < count; ++i)
+	{
+		servers.emplace_back(new LoopbackServer(sprintf("standin-%08x-%d", instance, i).getPtr(), config));
+		servers.back()->start();
+	}
+
+	std::signal(SIGINT, onSignal);
+	std::signal(SIGTERM, onSignal);
+
+	// Blocks until a line arrives; at the end of the input only the signals stop us.
+	std::thread([]() {
+		std::string line;
+		if (std::getline(std::cin, line))
+			s_quit = true;
+	}).detach();
+
+	::printf("%d stand-in server(s) rendering for %s at %.1f Msamples/s each, press Enter to stop\n",
+		count, config.host.c_str(), config.throughput * 1.0e-6);
+	::fflush(stdout);
+
+	U32 lastFrames = 0;
+	U64 lastBytes = 0;
+	while (!s_quit)
+	{
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		U32 frames = 0;
+		U64 bytes = 0;
+		for (auto& server : servers)
+		{
+			frames += server->getNumFramesSent();
+			bytes += server->getNumBytesSent();
+		}
+		::printf("%u frames/s, %.2f MB/s\n", frames - lastFrames, (bytes - lastBytes) / 1048576.0);
+		::fflush(stdout);
+		lastFrames = frames;
+		lastBytes = bytes;
+	}
+
+	for (auto& server : servers)
+		server->stop();
+	return 0;
+}